@@ -3,13 +3,17 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "romcache.h"
 
 #define MBC_MODE_ADDRESS 0x147
 #define ROM 0x148
 #define EXTERNAL_RAM 0x149
 #define LOCALE 0x14A
+//bit 7 set - the game supports the Game Boy Color (0x80 either, 0xC0 CGB only)
+#define CGB_FLAG 0x143
+#define CGB_SUPPORT_BIT 7
 
-#define MAX_CART_SIZE 0x20000
+#define ROM_BANK_SIZE 0x4000
 #define RAM_BANK_SIZE 0x2000
 
 enum mbcMode {
@@ -44,13 +48,16 @@ enum mbcMode {
 };
 
 struct cartridge {
-	uint8_t memory[MAX_CART_SIZE];
-	uint8_t ramBanks[RAM_BANK_SIZE];
+	const struct romImage * romImage; //shared with every other instance running this cart
+	const uint8_t * memory; //romImage->data - read only, mapped in by reference
+	uint32_t memorySize; //bytes in the image, a whole number of banks
+	struct page ** ramPages; //PAGES_PER_RAM_BANK per bank, NULL if the cart has no external RAM
 	enum mbcMode bankMode;
 	uint8_t currentROMBank;
 	uint8_t currentRAMBank;
 	bool romBanking; //defaults to true
 	bool ramEnabled;
+	bool cgb; //runs in Game Boy Color mode
 	uint16_t romBankCount;
 	uint16_t ramBankCount;
 	int romSize;
@@ -68,17 +75,24 @@ struct ramInfo {
 	uint16_t noOfBanks;
 };
 
-extern struct romInfo romInfoChoices[0x54];
-extern struct ramInfo ramInfoChoices[0x03];
+//the size codes in the header index these
+#define NO_OF_ROM_SIZE_CODES 0x55
+#define NO_OF_RAM_SIZE_CODES 0x06
+
+extern struct romInfo romInfoChoices[NO_OF_ROM_SIZE_CODES];
+extern struct ramInfo ramInfoChoices[NO_OF_RAM_SIZE_CODES];
 extern char * locales[0x2];
 
 struct gameboy;
+struct page;
 
 void loadGame(struct gameboy * gameboy, const char * directory);
 void loadBankType(struct gameboy * gameboy);
 void loadRomInfo(struct gameboy * gameboy);
 void loadRamInfo(struct gameboy * gameboy);
 void loadLocaleInfo(struct gameboy * gameboy);
+void loadColourMode(struct gameboy * gameboy);
 void printCartDetails(struct gameboy * gameboy);
+void unloadGame(struct gameboy * gameboy);
 
 #endif
@@ -0,0 +1,70 @@
+#ifndef CHEATS_H
+#define CHEATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Game Genie codes patch ROM. They look like ABC-DEF-GHI (or ABC-DEF without the
+compare value):
+	AB - the new data
+	FCDE xor 0xF000 - the address (0000-7FFF)
+	GI - the compare value, rotated right by 2 and xored with 0xBA. H is unused.
+If a compare value is given, the patch only applies where the original byte
+matches it, which is how a code picks out one ROM bank.
+
+Rather than checking every read, each 4kB ROM page a code touches gets a patched
+shadow copy, and the memory map points at the shadow instead of the cartridge
+image. The read path doesn't know cheats exist.
+
+GameShark codes write RAM (A000-DFFF). They are 8 hex digits, ttvvllhh:
+	tt - code type. 8x writes external RAM bank x, 9x work RAM bank x at
+	     D000-DFFF (CGB). Anything else, usually 01, writes the bank the
+	     game has switched in
+	vv - the value to write
+	hhll - the address
+They're applied once a frame when the LCD enters vblank, straight into the
+bank rather than through writeByte.
+*/
+
+#define MAX_GAME_GENIE_CODES 16
+#define MAX_GAMESHARK_CODES 16
+
+struct gameboy;
+struct page;
+
+struct gameGenieCode {
+	uint16_t address;
+	uint8_t data;
+	uint8_t compare;
+	bool hasCompare;
+};
+
+struct gameSharkCode {
+	uint16_t address;
+	uint8_t data;
+	uint8_t type;
+};
+
+struct patchedPage {
+	uint32_t romOffset; //which page of the cartridge image this shadows
+	struct page * page;
+};
+
+struct cheats {
+	struct gameGenieCode gameGenie[MAX_GAME_GENIE_CODES];
+	struct gameSharkCode gameShark[MAX_GAMESHARK_CODES];
+	int noOfGameGenieCodes;
+	int noOfGameSharkCodes;
+	struct patchedPage * patchedPages;
+	int noOfPatchedPages;
+};
+
+bool addGameGenieCode(struct gameboy * gameboy, const char * code);
+bool addGameSharkCode(struct gameboy * gameboy, const char * code);
+void clearCheats(struct gameboy * gameboy);
+void applyGameSharkCodes(struct gameboy * gameboy);
+void mapPatchedPages(struct gameboy * gameboy);
+bool shareCheats(struct gameboy * parent, struct gameboy * child);
+
+#endif
@@ -2,6 +2,7 @@
 #define CPU_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /*
 Details:
@@ -37,6 +38,14 @@ Represent 1 byte as an unsigned char
 
 #define NO_OF_INSTRUCTIONS 256
 
+/*
+Game Boy Color double speed mode. The game arms a switch through KEY1 then
+executes STOP. From then on the CPU (and OAM DMA) run twice as fast, but the
+LCD and HDMA keep their speed. cycles counts at the LCD's rate, so in double
+speed each instruction only adds half of its cycle count.
+*/
+#define SPEED_SWITCH_REG 0xFF4D
+
 /*
 Struct that represents an instruction, complete with a pointer to a function
 */
@@ -102,6 +111,8 @@ struct cpu {
 	uint16_t pc;
 	int cycles;
 	struct instruction previousInstruction;
+	bool doubleSpeed;
+	bool speedSwitchArmed;
 
 };
 
@@ -2,14 +2,76 @@
 #define DISPLAY_H
 
 #include <SDL/SDL.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lcd.h"
+#include "scaler.h"
 
-#define DISPLAY_X 255
-#define DISPLAY_Y 255
+/*
+Presentation thread. SDL and OpenGL live on a thread of their own, which
+polls input, scales and uploads frames and waits on the buffer swap. So a
+slow swap or a vsync wait never stretches emulated time - the emulation
+thread doesn't touch either. At the end of each drawn frame it copies the
+frame out, and at the start of each one it picks up the buttons held as of
+the presenter's last poll.
+
+Frames go through a triple buffer: one being filled by the emulation thread,
+one being presented, and the latest finished one in between. Each side
+trades its frame for the middle one with a single atomic exchange, so
+neither ever waits for the other. A frame the presenter doesn't get to in
+time is replaced by the next one, and a frame whose lines all hash the same
+as the last one passed on isn't passed on at all.
+
+The core only draws the indices (PIXEL_FORMAT_INDEXED). The presenter
+converts them into DISPLAY_PIXEL_FORMAT as it scales them, so the frame is
+only ever converted at the size it's uploaded.
+*/
+#define PRESENT_INDEX_MASK 0x03
+#define PRESENT_FRESH 0x04 //set on the middle frame until the presenter takes it
+#define PRESENT_IDLE_NS 1000000 //the presenter naps this long when there's no new frame
+
+//the frame is upscaled by the scaler before it's drawn, rather than stretched
+//by OpenGL
+#define DISPLAY_SCALE 3
+#define DISPLAY_FILTER SCALE_FILTER_SCALE3X
+#define DISPLAY_SCALER_WORKERS 2
+#define DISPLAY_X (X * DISPLAY_SCALE)
+#define DISPLAY_Y (Y * DISPLAY_SCALE)
 #define DISPLAY_BPP 8
+#define DISPLAY_PIXEL_FORMAT PIXEL_FORMAT_RGBA8888 //the texture's, whatever the core draws
+
+//the scaled frame is streamed into a texture through pixel buffers, taking
+//turns so a frame never waits on the upload of the one before
+#define DISPLAY_PIXEL_BUFFERS 2
 
 struct gameboy;
 
+//everything the presenter needs to convert a frame
+struct presentedFrame {
+	bool colourFrames;
+	struct palettes palettes;
+	uint8_t indices[X * Y];
+	uint16_t lineColours[Y][CGB_COLOURS];
+};
+
+struct presenter {
+	pthread_t thread;
+	struct presentedFrame frames[3];
+	int back; //the emulation thread's
+	int front; //the presenter's
+	_Atomic int middle; //with PRESENT_FRESH set until the presenter takes it
+	_Atomic uint8_t heldButtons;
+	_Atomic bool quit; //escape was pressed or the window closed
+	_Atomic bool stop;
+};
+
+void startEmulationLoop(struct gameboy * gameboy);
+void update(struct gameboy * gameboy);
 void startDisplay();
-void renderGraphics(struct gameboy * gameboy);
+void stopDisplay();
+void publishFrame(struct gameboy * gameboy);
+bool pollDisplayInput(struct gameboy * gameboy);
 
 #endif
@@ -1,5 +1,5 @@
 #ifndef DMA_H
-#define DMA
+#define DMA_H
 
 /*
 The CPU can only access the Sprite Attributes Table during LCD mode 2 (Sprite Attribute Search)
@@ -10,15 +10,68 @@ DMA is launched when the game attempts to write to memory address 0xFF46.
 The destination address of the DMA is the sprite RAM between 0xFE00 - 0xFE9F.
 This means that a total of 0xA0 bytes will be copied to this region.
 The source address is the data being written to 0xFF46 multiplied by 100.
+
+On real hardware the transfer takes 160 machine cycles (one byte per M-cycle, 640 clock
+cycles), and while it runs the CPU can only reach 0xFF00-0xFFFF - everything else on the
+bus reads back as 0xFF. Games start a DMA every frame from a routine in high RAM, so
+by default the whole block is copied in one go (DMA_FAST). DMA_ACCURATE spreads the
+copy over the real 160 M-cycles and blocks the bus while it runs.
+
+The Game Boy Color adds HDMA, which copies to VRAM in 16 byte blocks from a
+source and destination set in HDMA1-4. Writing the block count - 1 to HDMA5
+starts it:
+- bit 7 clear: general purpose, everything is copied at once and the CPU
+  waits for it (HDMA_BLOCK_CYCLES a block)
+- bit 7 set: HBlank, one block at the start of each HBlank. Writing HDMA5 with
+  bit 7 clear while it runs stops it
+A block never crosses a page on either side, so each one is resolved once
+through the memory map and copied in one go.
 */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define DMA_ADDRESS 0xFF46
+#define DMA_TRANSFER_LENGTH 0xA0
+#define CYCLES_PER_DMA_BYTE 4 //one M-cycle
+
+#define HDMA_SOURCE_HIGH_REG 0xFF51
+#define HDMA_SOURCE_LOW_REG 0xFF52
+#define HDMA_DESTINATION_HIGH_REG 0xFF53
+#define HDMA_DESTINATION_LOW_REG 0xFF54
+#define HDMA_CONTROL_REG 0xFF55
+#define HDMA_BLOCK_SIZE 0x10
+#define HDMA_BLOCK_CYCLES 32 //at the LCD's rate, whatever the CPU speed
+#define HDMA_HBLANK_BIT 7
 
 struct gameboy;
 
-void doDMATransfer(struct gameboy * gameboy, uint8_t data);
+enum dmaMode {
+	DMA_FAST,
+	DMA_ACCURATE
+};
 
+struct dma {
+	enum dmaMode mode;
+	bool active;
+	uint16_t source;
+	uint8_t bytesTransferred;
+	int cycleCounter;
+
+	//CGB HDMA
+	bool hdmaActive; //an HBlank transfer is running
+	uint16_t hdmaSource;
+	uint16_t hdmaDestination;
+	int hdmaBlocksLeft;
+};
+
+void initialiseDMA(struct gameboy * gameboy);
+void setDMAMode(struct gameboy * gameboy, enum dmaMode mode);
+void doDMATransfer(struct gameboy * gameboy, uint8_t data);
+void updateDMA(struct gameboy * gameboy);
+bool isDMABlockingBus(struct gameboy * gameboy, uint16_t address);
+void startHDMA(struct gameboy * gameboy, uint8_t data);
+void doHBlankDMA(struct gameboy * gameboy);
+uint8_t getHDMAStatus(struct gameboy * gameboy);
 
 #endif
@@ -7,24 +7,40 @@
 #include "interrupt.h"
 #include "lcd.h"
 #include "joypad.h"
+#include "dma.h"
+#include "cheats.h"
 
+#define CACHE_LINE_SIZE 64
+
+/*
+Laid out hottest first: the CPU, timer, interrupt and LCD registers touched on
+every instruction sit together in the first couple of cache lines, followed by
+the memory map. The bulk RAM arrays come last. ROM, external RAM and the
+framebuffer live outside the struct (see cartridge and screen), so an instance
+is mostly its pages of video/work RAM - 16kB on a DMG, 48kB once a colour
+game has added the CGB banks.
+*/
 struct gameboy {
-	struct cpu cpu;
-	struct memory memory;
-	struct cartridge cartridge;
+	_Alignas(CACHE_LINE_SIZE) struct cpu cpu;
 	struct timers timers;
 	struct interrupts interrupts;
 	struct screen screen;
+	struct dma dma;
 	struct joypad joypad;
+	struct cartridge cartridge;
+	struct cheats cheats;
+	_Alignas(CACHE_LINE_SIZE) struct memory memory;
 	//have an error code field - if an error occurs, set it, exit the emu loop, 
 	//then let the calling scope extract and handle it
 	//struct error error;
 };
 
 struct gameboy * createGameboy();
-void startEmulationLoop(struct gameboy * gameboy);
-void update(struct gameboy * gameboy);
+void runFrame(struct gameboy * gameboy);
 void reset(struct gameboy * gameboy);
 void destroyGameboy(struct gameboy * gameboy);
+//fork a running instance into noOfChildren copies that share memory with it
+//copy-on-write. Returns how many children were created.
+int forkGameboy(struct gameboy * parent, struct gameboy ** children, int noOfChildren);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef INPUT_SCRIPT_H
+#define INPUT_SCRIPT_H
+
+/*
+Scripted input, for hosts with no keyboard. A script is a text file of
+"<frame> <buttons>" lines in frame order, where buttons is a '+' separated
+list of UP, DOWN, LEFT, RIGHT, A, B, START and SELECT, or - for none. They're
+held from that frame until a later line changes them. Lines starting with #
+are ignored.
+	#press start on the title screen, then walk right
+	120 START
+	125 -
+	300 RIGHT
+	400 RIGHT+A
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct inputEvent {
+	int frame;
+	uint8_t held; //bit n set - button n is held
+};
+
+struct inputScript {
+	struct inputEvent * events;
+	int count;
+	int next; //the first event that hasn't happened yet
+	uint8_t held;
+};
+
+struct inputScript * loadInputScript(const char * path);
+//frames have to be asked for in order
+uint8_t getScriptedButtons(struct inputScript * script, int frame);
+void freeInputScript(struct inputScript * script);
+
+#endif
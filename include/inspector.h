@@ -0,0 +1,77 @@
+#ifndef INSPECTOR_H
+#define INSPECTOR_H
+
+/*
+VRAM/OAM inspector, for debugging what the renderers are given rather than
+what they draw.
+
+The host asks for a snapshot with requestInspection. At the next vblank the
+emulation thread copies VRAM (both banks), OAM, LCDC and the palettes - about
+16kB of memcpy, and nothing at all on frames nobody asked for. Then it flags
+the snapshot ready. getInspection hands it over once it's ready, and it's
+left alone until the host asks for another, so the host can decode it on
+any thread while emulation carries on.
+
+Everything is decoded from the snapshot with the same tile decoder as the
+renderers, into buffers with the same pixel encoding as indexBuffer:
+- the tile sheet - a bank's 384 tiles, 16 to a row, with the BG palette
+  (CGB palette 0)
+- a background map - all 32x32 tiles of 0x9800 or 0x9C00, addressed the way
+  LCDC was set, with CGB attributes
+- the sprite table - the 40 OAM entries with their attributes pulled apart
+saveInspectorImage writes any of the images out as a binary PPM.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "lcd.h"
+#include "memory.h"
+
+#define TILES_PER_SHEET_ROW 16
+#define TILE_SHEET_WIDTH (TILES_PER_SHEET_ROW * TILE_SIZE)
+#define TILE_SHEET_HEIGHT ((NO_OF_TILES / TILES_PER_SHEET_ROW) * TILE_SIZE)
+#define TILE_MAP_TILES 32
+#define TILE_MAP_WIDTH (TILE_MAP_TILES * TILE_SIZE)
+#define TILE_MAP_HEIGHT (TILE_MAP_TILES * TILE_SIZE)
+
+struct gameboy;
+
+struct inspectorSnapshot {
+	bool cgb;
+	uint8_t control;
+	uint8_t videoRam[NO_OF_VRAM_BANKS][VRAM_SIZE];
+	uint8_t spriteTable[SPRITE_RAM_SIZE];
+	uint8_t pixel[NO_OF_PALETTES][4];
+	uint16_t colours[CGB_COLOURS];
+	struct colour shades[4];
+};
+
+struct inspector {
+	_Atomic bool requested; //set by the host, cleared once the snapshot's taken
+	_Atomic bool ready;
+	struct inspectorSnapshot snapshot;
+};
+
+struct spriteEntry {
+	int x; //screen position of the top left pixel
+	int y;
+	uint8_t tile;
+	uint8_t attributes;
+	bool visible; //on screen, or partly
+	bool behindBackground;
+	bool xFlip;
+	bool yFlip;
+	int palette; //OBP0/1 on a DMG, 0-7 on a CGB
+	int bank;
+};
+
+bool requestInspection(struct gameboy * gameboy);
+const struct inspectorSnapshot * getInspection(struct gameboy * gameboy);
+void takeInspectorSnapshot(struct gameboy * gameboy);
+void drawTileSheet(const struct inspectorSnapshot * snapshot, int bank, uint8_t * out);
+void drawTileMap(const struct inspectorSnapshot * snapshot, uint16_t tileMap, uint8_t * out);
+void readSpriteTable(const struct inspectorSnapshot * snapshot, struct spriteEntry * entries);
+bool saveInspectorImage(const struct inspectorSnapshot * snapshot, const char * path, const uint8_t * pixels, int width, int height);
+
+#endif
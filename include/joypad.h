@@ -1,8 +1,8 @@
 #ifndef JOYPAD_H
 #define JOYPAD_H
 
-#include <SDL/SDL.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define JOYPAD_REG 0xFF00
 #define JOYPAD_REG_INIT 0xF
@@ -43,14 +43,7 @@ enum button {
 	UP
 };
 
-struct buttonMap {
-	enum button button;
-	SDLKey sdlKey;
-};
-
 struct joypad {
-	uint8_t * state; //0xFF00
-	uint8_t * previousState;
 	uint8_t reg;
 	uint8_t buttonState;
 	bool buttonMode; //0 for directions, 1 for buttons
@@ -66,9 +59,11 @@ struct joypad {
 	*/
 };
 
-extern struct buttonMap buttons[NO_OF_BUTTONS];
-
-void updateJoypadState(struct gameboy * gameboy, Uint8 * keys);
+//bit n of held set - button n is held
+void setHeldButtons(struct gameboy * gameboy, uint8_t held);
+//drive a button directly - eg. for forked instances that each
+//get different input
+void setButton(struct gameboy * gameboy, enum button buttonIndex, bool pressed);
 
 /*
 void pressUp(struct gameboy * gameboy);
@@ -81,13 +76,4 @@ void pressStart(struct gameboy * gameboy);
 void pressSelect(struct gameboy * gameboy);
 */
 
-/*
-Called when SDL key event is received
-Send this event to the joypad, which will figure out if it is a valid key
-if valid, set correct bits, request any interrupts
-*/
-void doJoypad(struct gameboy * gameboy, SDL_Event * event, Uint8 ** keys, bool * quit);
-void keyPressed(struct gameboy * gameboy, SDL_Event * event);
-void handleKeys(SDL_Event * event, int * quit);
-void startKeyModule();
 #endif
@@ -0,0 +1,22 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+/*
+SDL keyboard input for the windowed frontend. The core's joypad only takes
+button states (see joypad.h), so nothing outside the frontend needs SDL.
+*/
+
+#include <SDL/SDL.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "joypad.h"
+
+struct buttonMap {
+	enum button button;
+	SDLKey sdlKey;
+};
+
+extern struct buttonMap buttons[NO_OF_BUTTONS];
+
+uint8_t getHeldButtons(Uint8 * keys);
+#endif
@@ -3,26 +3,30 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
 
 /*
 The gameboy draws each scanline from 0 to 153. 
 From 144 to 153 is the v blank period.
-Each scanline takes 456 cpu clock cycles to draw. This can be kept track of 
-with a counter, similar to how the timers work.
+Each scanline takes 456 cpu clock cycles to draw. Rather than counting these
+after every instruction, the LCD schedules its next mode change at an absolute
+CPU cycle, and nothing runs until the CPU gets there.
 */
 
 #define X 160
 #define Y 144
 
 #define NO_OF_INVISIBLE_SCANLINES 9
+#define LINES_PER_FRAME (Y + NO_OF_INVISIBLE_SCANLINES + 1)
 
 #define CONTROL_REG 0xFF40
 #define STATUS_REG 0xFF41
-#define SCROLL_X 0xFF42
-#define SCROLL_Y 0xFF43
+#define SCROLL_Y 0xFF42
+#define SCROLL_X 0xFF43
 #define CURRENT_SCANLINE 0xFF44
 //when LY_COMPARE == coincident bit in status reg, stat interrupt is requested
 #define LY_COMPARE 0xFF45
+#define LCD_REG_END 0xFF4B //the last register that changes what's drawn
 
 //Specifes the upper/left positions of the window - an alternate background
 //area which is displayed above the normal background.
@@ -31,9 +35,13 @@ with a counter, similar to how the timers work.
 	//WY = 0 to 143
 //A position of WX=7, WY=0 locates the window at the upper left, completely
 //covering the background
+//The window keeps its own line counter rather than using LY - WY. It starts
+//at 0 each frame and only moves on lines the window is actually drawn on, so
+//hiding it for a few lines (a status bar split) carries on from the same row
 
-#define WINDOW_POS_X 0xFF4A
-#define WINDOW_POS_Y 0xFF4B
+#define WINDOW_POS_Y 0xFF4A
+#define WINDOW_POS_X 0xFF4B
+#define WINDOW_HIDDEN -1 //window line of a line without the window
 
 #define BG_PALETTE_DATA 0xFF47
 #define OBJECT_PALETTE_0_DATA 0xFF48
@@ -41,10 +49,15 @@ with a counter, similar to how the timers work.
 
 #define SCANLINE_CYCLE_TIME 456
 
-#define SPRITE_ATTR_CYCLE_LOWER 0
-#define SPRITE_ATTR_CYCLE_UPPER 80
-#define DRIVER_TRANSFER_CYCLE_LOWER 80
-#define DRIVER_TRANSFER_CYCLE_UPPER 252
+//a visible line is mode 2, then mode 3, then mode 0
+#define OAM_SEARCH_CYCLES 80
+#define TRANSFER_CYCLES 172
+#define HBLANK_CYCLES (SCANLINE_CYCLE_TIME - OAM_SEARCH_CYCLES - TRANSFER_CYCLES)
+#define LCD_OFF_CYCLE INT_MAX //next event while the LCD is off - never
+
+#define LCD_CONTROL_INIT 0x91
+#define STATUS_MODE_MASK 0x03
+#define STATUS_WRITABLE_MASK 0x78
 
 #define HBLANK_ENABLE_BIT 3
 #define VBLANK_ENABLE_BIT 4
@@ -114,6 +127,47 @@ Every 2 bits in a palette represent a colour
 #define REGION_TWO_BG_MEMORY 0x9C00
 #define REGION_ONE_BG_MEMORY 0x9800
 
+/*
+Tile cache. Every one of the 384 tiles in 0x8000-0x97FF is kept decoded into
+8x8 colour IDs, so drawing a pixel is a lookup rather than two VRAM reads and
+some bit twiddling. A write to tile data marks just that tile row dirty, and
+the row is decoded again the next time it is drawn. In colour mode the 384
+tiles of VRAM bank 1 follow them - a DMG cache only has room for the first.
+*/
+#define TILE_DATA_START 0x8000
+#define TILE_DATA_END 0x9800
+#define NO_OF_TILES 384
+#define TILE_SIZE 8
+#define BYTES_PER_TILE 16
+#define NO_OF_CACHED_TILES (2 * NO_OF_TILES) //a CGB has a second bank of tiles after the first
+
+struct tileCache {
+	int noOfTiles; //NO_OF_TILES, or NO_OF_CACHED_TILES in colour mode
+	uint8_t dirtyRows[NO_OF_CACHED_TILES]; //bit n set - row n needs decoding
+	uint8_t pixels[][TILE_SIZE][TILE_SIZE]; //noOfTiles of them
+};
+
+/*
+Sprite cache. OAM is only rescanned when it changes (a write to 0xFE00-0xFE9F,
+a DMA transfer, or the sprite size changing) rather than on every scanline.
+Each line keeps the OAM indices of the sprites on it - at most 10, like the
+hardware - sorted so the sprite that ends up on top comes first.
+*/
+#define NO_OF_SPRITES 40
+#define BYTES_PER_SPRITE 4
+#define MAX_SPRITES_PER_LINE 10
+
+struct spriteLine {
+	uint8_t count;
+	uint8_t sprites[MAX_SPRITES_PER_LINE];
+};
+
+struct spriteCache {
+	bool dirty;
+	bool tallSprites; //the sprite size the lines were built for
+	struct spriteLine lines[Y];
+};
+
 struct gameboy;
 struct colour {
 	uint8_t red;
@@ -128,20 +182,183 @@ enum COLOUR {
 	BLACK
 };
 
+/*
+The renderers draw into indexBuffer, one byte per pixel: the shade after the
+palette in bits 1/0 and the palette it came from in bits 3/2. The shade is
+fixed when the pixel is drawn, so palette changes mid frame still show.
+
+At vblank the frame is converted to the host format in one pass, so the host
+gets exactly what it uploads or encodes:
+- RGB888: 3 bytes a pixel, R G B
+- RGBA8888/BGRA8888: 4 bytes a pixel in that byte order, alpha 0xFF, for
+  direct texture upload
+- RGB565: one native-endian uint16_t a pixel, red in the top 5 bits, for
+  consumers limited by memory bandwidth
+Hosts that only need the shades (hashing frames, feeding a model) can pick
+PIXEL_FORMAT_INDEXED, which skips the conversion and has no frameBuffer -
+indexBuffer & PIXEL_SHADE_MASK is the raw 2-bit shade.
+*/
+#define PIXEL_SHADE_MASK 0x03
+#define PIXEL_PALETTE_SHIFT 2
+
+/*
+Game Boy Color frames use the same buffer, but each byte is an index into
+the 64 colours of palette RAM instead: the colour ID in bits 1/0, the palette
+in bits 4-2 and bit 5 set for sprites. The colours themselves are 15 bit
+RGB555, logged with each line (games change them between lines), and only
+turned into host pixels when the frame is converted. PIXEL_FORMAT_INDEXED
+hosts get the colour index, and read the colours from lineColours. DMG
+frames have no use for lineColours, so it's only there in colour mode (see
+setColourFrames).
+*/
+#define CGB_PIXEL_MASK 0x3F
+#define CGB_OBJ_PIXEL 0x20
+#define CGB_COLOURS 64
+#define CGB_PALETTE_RAM_SIZE 64 //bytes each for BG and OBJ - 8 palettes of 4 colours
+
+enum pixelFormat {
+	PIXEL_FORMAT_RGB888,
+	PIXEL_FORMAT_RGBA8888,
+	PIXEL_FORMAT_BGRA8888,
+	PIXEL_FORMAT_RGB565,
+	PIXEL_FORMAT_INDEXED
+};
+
+/*
+Palette lookup tables. Each palette register is kept expanded into the shade
+and tagged pixel of its 4 colour IDs, so drawing a pixel is a single lookup.
+A table is only rebuilt when the game writes its register (or the host picks
+different shades), rather than decoding the register for every pixel.
+
+The host colours for the 4 shades can be swapped for any 4 entry table -
+setShades(gameboy, greenShades) gives the original green screen look. They're
+kept ready in the host format too (channels reordered, or packed to 16 bits),
+so converting a pixel is one lookup whatever the format.
+*/
+#define BG_PALETTE_REG 0xFF47
+#define OBJ_PALETTE_0_REG 0xFF48
+#define OBJ_PALETTE_1_REG 0xFF49
+
+//CGB palette RAM is read and written a byte at a time through the data
+//registers, at the byte the index register points to. Bit 7 of the index
+//moves it on after each write
+#define BG_COLOUR_INDEX_REG 0xFF68
+#define BG_COLOUR_DATA_REG 0xFF69
+#define OBJ_COLOUR_INDEX_REG 0xFF6A
+#define OBJ_COLOUR_DATA_REG 0xFF6B
+#define COLOUR_INDEX_INCREMENT_BIT 7
+
+enum paletteId {
+	BG_PALETTE,
+	OBJ_PALETTE_0,
+	OBJ_PALETTE_1,
+	NO_OF_PALETTES
+};
+
+struct palettes {
+	const struct colour * shades; //host colours for white, light grey, dark grey and black
+	struct colour channelShades[4]; //shades with the channels in the host format's byte order
+	uint16_t packedShades[4]; //shades packed for RGB565
+	uint8_t pixel[NO_OF_PALETTES][4]; //colour ID -> shade | (palette << PIXEL_PALETTE_SHIFT)
+	uint8_t colourRam[2][CGB_PALETTE_RAM_SIZE]; //BG then OBJ, little endian RGB555
+	uint16_t colours[CGB_COLOURS]; //colourRam as colours, indexed like a CGB pixel
+};
+
+extern const struct colour greyscaleShades[4];
+extern const struct colour greenShades[4];
+
+/*
+Frame skipping. A skipped frame is still fully emulated - LY, STAT, the mode
+and vblank interrupts all advance as normal - but no scanlines are logged, so
+there's no pixel work, and the frame isn't converted or presented.
+
+FRAME_SKIP_FIXED draws one frame in every interval (2 is every other frame).
+FRAME_SKIP_AUTO only skips while the host reports it is behind real time,
+and never more than interval frames in a row.
+FRAME_SKIP_ALL never draws a frame, starting with the one in progress, for
+hosts with no use for them. The interval is ignored.
+*/
+enum frameSkipMode {
+	FRAME_SKIP_OFF,
+	FRAME_SKIP_FIXED,
+	FRAME_SKIP_AUTO,
+	FRAME_SKIP_ALL
+};
+
+struct frameSkip {
+	enum frameSkipMode mode;
+	int interval;
+	int counter; //frames since the last one drawn
+	bool skipping; //the frame in progress isn't being drawn
+	bool hostBehind;
+	bool frameReady; //a drawn frame is waiting to be presented
+	bool frameChanged; //and it differs from the one before (always set for indexed hosts)
+};
+
+/*
+Deferred rendering. While the CPU runs, each visible line only records the
+registers it would be drawn with. The whole frame is drawn in one batch at
+vblank, or whenever the host calls renderPendingLines.
+
+VRAM and OAM aren't logged. Instead, a write to either draws the lines
+logged so far first, so they still see the old contents. Games mostly write
+them during vblank, when there is nothing pending.
+
+In colour mode each line's 64 CGB colours are logged too, into the screen's
+loggedColours rather than the line itself, so a DMG doesn't carry them.
+*/
+struct scanlineState {
+	uint8_t control;
+	uint8_t scrollY;
+	uint8_t scrollX;
+	uint8_t windowX;
+	int windowLine; //row of the window drawn on this line, or WINDOW_HIDDEN
+	uint8_t pixel[NO_OF_PALETTES][4]; //the palette tables when the line started
+};
+
+struct frameLog {
+	int logged; //lines 0 to logged - 1 have been logged this frame
+	int rendered; //and lines 0 to rendered - 1 drawn
+	struct scanlineState lines[Y];
+};
+
+//the scanline renderer draws a line at a time from the registers as they were
+//when it started. The pixel FIFO draws a dot at a time, so it picks up changes
+//made part way through a line (see pixelFifo.h), and costs more
+enum renderMode {
+	RENDER_SCANLINE,
+	RENDER_PIXEL_FIFO
+};
+
 struct screen {
 	uint8_t control;
 	uint8_t status;
 	uint8_t scrollY;
 	uint8_t scrollX;
 	uint8_t currentScanline; //writing resets the counter
-	int scanlineCounter;
+	int nextEventCycle; //CPU cycle of the next mode change
+	int lineStartCycle;
 	//redirect read from 0xFF44 to currentScanline
-	uint8_t windowXPos;
-	uint8_t windowYPos;
-	bool currentLCDInterruptEnabled;
-	struct colour frameBuffer[X * Y];
-	uint8_t frameBuffer3D[X][Y][3]; //3D array of RGB values
-	uint8_t frameBufferNew[X * Y * 3];
+	uint8_t windowLine; //the window's internal line counter
+	bool windowYReached; //LY has matched WY this frame, the window can start
+	enum pixelFormat pixelFormat;
+	uint8_t * indexBuffer;
+	uint8_t * frameBuffer; //host format, NULL when PIXEL_FORMAT_INDEXED
+	uint64_t * convertedHashes; //lineHashes when frameBuffer was last converted, NULL with it
+	uint64_t * lineHashes; //of each line of indexBuffer, set as it's drawn (see renderer.h)
+	uint16_t (*lineColours)[CGB_COLOURS]; //each line's CGB colours, drawn with indexBuffer. NULL on a DMG
+	uint16_t (*loggedColours)[CGB_COLOURS]; //and as they were when each line was logged (see frameLog)
+	bool colourFrames; //indexBuffer holds CGB colour indices rather than shades
+	bool convertAll; //convertedHashes don't match frameBuffer any more
+	struct palettes palettes;
+	struct frameSkip frameSkip;
+	struct tileCache * tileCache;
+	struct spriteCache * spriteCache;
+	struct frameLog * frameLog;
+	struct renderThread * renderThread; //NULL when drawing inline
+	enum renderMode renderMode;
+	struct pixelFifo * pixelFifo;
+	struct inspector * inspector; //NULL until the host asks for a VRAM snapshot
 };
 
 enum controlBit {
@@ -190,9 +407,34 @@ interested in (0xFF45). This is usually used to do special effects on the displa
 
 If they are the same values, then an interrupt is requested
 */
-void setLCDStatus(struct gameboy * gameboy);
 bool isLCDEnabled(struct gameboy * gameboy);
 void updateGraphics(struct gameboy * gameboy);
-void updateGraphicsTest(struct gameboy * gameboy);
-void drawScanline(struct gameboy * gameboy);
+void setLCDControl(struct gameboy * gameboy, uint8_t data);
+void setLCDStatus(struct gameboy * gameboy, uint8_t data);
+void resetScanline(struct gameboy * gameboy);
+void resetLCD(struct gameboy * gameboy);
+void rebaseLCDCycles(struct gameboy * gameboy, int cycles);
+void logScanline(struct gameboy * gameboy, int windowLine);
+void renderPendingLines(struct gameboy * gameboy);
+void setShades(struct gameboy * gameboy, const struct colour * shades);
+void updatePalette(struct gameboy * gameboy, uint16_t address);
+void beforeVideoRamWrite(struct gameboy * gameboy, uint16_t address);
+void beforeSpriteTableWrite(struct gameboy * gameboy);
+void beforeLCDRegisterWrite(struct gameboy * gameboy);
+bool setRenderMode(struct gameboy * gameboy, enum renderMode mode);
+void invalidateRenderCaches(struct gameboy * gameboy);
+void setFrameSkip(struct gameboy * gameboy, enum frameSkipMode mode, int interval);
+void setHostBehind(struct gameboy * gameboy, bool behind);
+bool takeFrame(struct gameboy * gameboy);
+bool hasFrameChanged(struct gameboy * gameboy);
+int getBytesPerPixel(enum pixelFormat format);
+void convertPixels(const struct screen * screen, int line, const uint8_t * indices, int count, uint8_t * out);
+void buildHostShades(struct screen * screen);
+void writeColourPalette(struct gameboy * gameboy, uint16_t address, uint8_t data);
+uint8_t readColourPalette(struct gameboy * gameboy, uint16_t address);
+void resetColourPalettes(struct gameboy * gameboy);
+bool copyScreenBuffers(struct gameboy * parent, struct gameboy * child);
+void freeScreenBuffers(struct gameboy * gameboy);
+bool setPixelFormat(struct gameboy * gameboy, enum pixelFormat format);
+bool setColourFrames(struct gameboy * gameboy, bool colourFrames);
 #endif
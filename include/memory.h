@@ -5,8 +5,6 @@
 #include <stdbool.h>
 #include "cartridge.h"
 
-#define TOTAL_MEMORY_SIZE 0xFFFF
-#define MAX_CART_SIZE 0x20000
 #define CARTRIDGE_SIZE 0x8000
 #define VRAM_SIZE 0x2000
 #define EXTERNAL_RAM_SIZE 0x2000
@@ -37,6 +35,8 @@
 #define SPRITE_RAM_START 0xFE00
 #define SPRITE_RAM_SIZE 0xA0
 
+#define IO_START 0xFF00
+
 #define RAM_BANK_ENABLE_UPPER 0x2000
 #define ROM_BANK_NUMBER_LOWER 0x2000 
 #define ROM_BANK_NUMBER_UPPER 0x3FFF
@@ -106,13 +106,91 @@ enum mbcMode {
 */
 
 
+/*
+The address space is split into 16 pages of 4kB. readMap/writeMap hold a pointer
+to the storage backing each page, so most reads and writes are a single table
+lookup. A NULL entry means the page needs special handling - MBC registers in the
+ROM area, disabled external RAM, and the 0xF000 page holding OAM and the I/O
+registers. Bank switches just repoint the affected entries.
+
+ROM isn't copied into the instance - the ROM pages point straight into the
+cartridge image.
+
+Video, work and external RAM live in reference counted pages so that a forked
+instance can share them with its parent (see forkGameboy). A shared page is
+readable through readMap but left out of writeMap, so the first write to it
+takes the slow path, which gives the instance its own copy and remaps it.
+*/
+#define PAGE_SHIFT 12
+#define PAGE_SIZE 0x1000
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define NO_OF_PAGES 0x10
+
+#define VRAM_START 0x8000
+#define WORK_RAM_START 0xC000
+
+#define NO_OF_VRAM_PAGES (VRAM_SIZE >> PAGE_SHIFT)
+#define NO_OF_WORK_RAM_PAGES (WORK_RAM_SIZE >> PAGE_SHIFT)
+#define PAGES_PER_RAM_BANK (RAM_BANK_SIZE >> PAGE_SHIFT)
+
+/*
+Game Boy Color banking. VBK picks which of the 2 VRAM banks is at 8000-9FFF,
+and SVBK which of work RAM banks 1-7 is at D000-DFFF (0 picks 1). Either is
+just a remap of the affected pages. In DMG mode the registers are ignored,
+so only VRAM bank 0 and work RAM banks 0 and 1 are ever seen - the rest are
+only allocated once a colour game is loaded (allocateColourBanks), and are
+NULL until then.
+*/
+#define VRAM_BANK_REG 0xFF4F
+#define WORK_RAM_BANK_REG 0xFF70
+#define NO_OF_VRAM_BANKS 2
+#define NO_OF_WORK_RAM_BANKS 8 //4kB each, bank 0 is always at C000
+#define NO_OF_DMG_WORK_RAM_BANKS 2
+#define TOTAL_VRAM_PAGES (NO_OF_VRAM_BANKS * NO_OF_VRAM_PAGES)
+
+struct page {
+	_Atomic int refCount;
+	uint8_t data[PAGE_SIZE];
+};
+
 struct memory {
-	uint8_t mem[TOTAL_MEMORY_SIZE];
+	const uint8_t * readMap[NO_OF_PAGES];
+	uint8_t * writeMap[NO_OF_PAGES];
+	//8000-9FFF - 8kb Video RAM. Bank b is pages b * NO_OF_VRAM_PAGES onwards
+	struct page * videoRam[TOTAL_VRAM_PAGES];
+	//C000-CFFF - Work RAM bank 0, D000-DFFF - the selected bank, echoed at E000-FDFF
+	struct page * workRam[NO_OF_WORK_RAM_BANKS];
+	uint8_t videoRamBank;
+	uint8_t workRamBank;
+	//FE00-FE9F - Sprite Attribute Table (OAM)
+	uint8_t spriteTable[SPRITE_RAM_SIZE];
+	//FF00-FFFF - I/O Ports, High RAM and the interrupt enable register
+	uint8_t io[IO_SIZE];
 };
 
 void writeByte(struct gameboy * gameboy, uint16_t address, uint8_t data);
 void writeWord(struct gameboy * gameboy, uint16_t address, uint16_t data);
 uint8_t readByte(struct gameboy * gameboy, uint16_t address);
 uint16_t readWord(struct gameboy * gameboy, uint16_t address);
+//returns a pointer to the backing storage for address, resolved through the
+//memory map. Used for block copies that bypass readByte. NULL if unmapped.
+const uint8_t * getMemoryBlock(struct gameboy * gameboy, uint16_t address);
+//copies length bytes into the current VRAM bank. The block mustn't cross a page
+void writeVideoRamBlock(struct gameboy * gameboy, uint16_t address, const uint8_t * data, int length);
+//writes external or work RAM in the given bank, whether or not it's the one
+//mapped and whether or not external RAM is enabled. For cheats
+void writeRAMBank(struct gameboy * gameboy, uint16_t address, uint8_t bank, uint8_t data);
+void initialiseMemoryMap(struct gameboy * gameboy);
+bool allocateMemory(struct gameboy * gameboy);
+void clearMemory(struct gameboy * gameboy);
+void freeMemory(struct gameboy * gameboy);
+bool shareMemory(struct gameboy * parent, struct gameboy * child);
+bool allocateColourBanks(struct gameboy * gameboy);
+void freeColourBanks(struct gameboy * gameboy);
+
+struct page * allocatePage();
+void releasePage(struct page * page);
+void mapROMBank(struct gameboy * gameboy);
+void mapRAMBank(struct gameboy * gameboy);
 
 #endif
@@ -0,0 +1,105 @@
+#ifndef PIXEL_FIFO_H
+#define PIXEL_FIFO_H
+
+/*
+Pixel FIFO renderer - the accurate alternative to drawing whole scanlines at
+once, for games that change registers part way through a line.
+
+It follows the PPU dot by dot through mode 3. A fetcher reads the tile number
+and the two bytes of tile data (2 dots each), then pushes 8 pixels into the
+background FIFO once it has room. One pixel a dot is shifted out to the LCD,
+mixed with the sprite FIFO. So mode 3 stretches the way it does on hardware:
+- the first tile is fetched twice at the start of the line (6 dots)
+- SCX % 8 pixels are fetched and thrown away
+- switching to the window restarts the fetcher (6 dots), and takes the next
+  row from the window's line counter
+- each sprite waits for the fetcher to finish its tile, then takes 6 dots
+
+Nothing runs ahead of the CPU. The FIFO is caught up to the current cycle
+before any write that could change what's drawn (VRAM, OAM and the LCD
+registers), so every pixel is drawn with the values that were live at its dot.
+
+On a skipped frame the FIFO still runs, since mode 3's length depends on it,
+but only counts dots: nothing is read from VRAM, decoded or drawn.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lcd.h"
+
+#define FIFO_SIZE 16
+#define FETCH_STEP_DOTS 2
+#define FIRST_FETCH_DOTS 6 //the throwaway fetch at the start of every line
+#define SPRITE_FETCH_DOTS 6
+
+struct gameboy;
+
+enum fetchStep {
+	FETCH_TILE,
+	FETCH_DATA_LOW,
+	FETCH_DATA_HIGH,
+	FETCH_PUSH
+};
+
+struct spritePixel {
+	uint8_t colourId; //0 is transparent
+	uint8_t palette;
+	bool behindBackground;
+};
+
+struct pixelFifo {
+	bool drawing; //mode 3 of line is in progress
+	bool drawPixels; //false on skipped frames - only the timing is kept
+	int line;
+	int startCycle; //CPU cycle mode 3 started on
+	int dots; //dots run since then
+	int stall; //dots the pixel pipeline does nothing for
+	int x; //next LCD pixel
+	int discard; //pixels still to be thrown away before x moves
+	bool inWindow;
+	bool windowYReached; //as it was when the line started
+	uint8_t windowLine; //row of the window being drawn, once it has started
+
+	//the LCD registers, latched at each catch up - they can't change in one
+	uint8_t scrollY;
+	uint8_t scrollX;
+	uint8_t windowX;
+	bool backgroundEnabled;
+	bool windowEnabled;
+	bool spritesEnabled;
+	bool tallSprites;
+	bool unsignedTiles;
+	uint16_t backgroundMap;
+	uint16_t windowMap;
+
+	//background/window fetcher
+	enum fetchStep step;
+	int stepDots;
+	int fetchX; //tile column being fetched
+	uint8_t tileNum;
+	uint8_t dataLow;
+	uint8_t dataHigh;
+
+	//background FIFO - colour IDs, in a ring
+	uint8_t background[FIFO_SIZE];
+	int backgroundHead;
+	int backgroundCount;
+
+	//sprite FIFO - the slot at (spriteHead + n) % 8 is n pixels right of x
+	struct spritePixel sprites[TILE_SIZE];
+	int spriteHead;
+	int spriteFetchDots; //left on the sprite being fetched
+
+	//the line's sprites, in the order they're fetched
+	uint8_t lineSprites[MAX_SPRITES_PER_LINE];
+	uint8_t lineSpriteX[MAX_SPRITES_PER_LINE];
+	int lineSpriteCount;
+	int nextSprite;
+};
+
+void startFifoLine(struct gameboy * gameboy, int startCycle);
+void catchUpPixelFifo(struct gameboy * gameboy);
+bool finishFifoTransfer(struct gameboy * gameboy);
+int getFifoPixelsLeft(struct gameboy * gameboy);
+
+#endif
@@ -4,6 +4,7 @@
 
 #define INIT_PROGRAM_COUNTER 0x100
 #define INIT_AF 0x01B0
+#define INIT_AF_CGB 0x1180 //A = 0x11 is how games tell they're on a CGB
 #define INIT_BC 0x0013
 #define INIT_DE 0x00D8
 #define INIT_HL 0x014D
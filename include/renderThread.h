@@ -0,0 +1,83 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+/*
+Optional render thread. When it's running, the lines logged on the emulation
+thread are handed over in jobs instead of being drawn there, so frame N is
+drawn while frame N+1 is emulated. The finished frame is picked up at the
+next vblank, so what's presented is one frame behind. It's otherwise
+bit-identical to drawing inline.
+
+Jobs go through a fixed ring that only the emulation thread adds to and only
+the render thread takes from, so head and tail are plain atomics - no locks.
+Each job carries the logged state of its lines. OAM is only copied into a
+job when it's changed since the last one, and VRAM only by the 256 byte
+block - a game streaming tiles in hblank dirties a block or two between
+jobs, not all 16kB. The render thread keeps its own copy of both, with its
+own tile and sprite caches, sized for the mode it was started in.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lcd.h"
+#include "memory.h"
+
+#define RENDER_QUEUE_LENGTH 8
+#define VRAM_BLOCK_SHIFT 8
+#define VRAM_BLOCK_SIZE (1 << VRAM_BLOCK_SHIFT)
+#define NO_OF_VRAM_BLOCKS ((NO_OF_VRAM_BANKS * VRAM_SIZE) >> VRAM_BLOCK_SHIFT) //64, a bit each
+#define ALL_VRAM_BLOCKS UINT64_MAX
+
+struct gameboy;
+
+struct renderJob {
+	int first; //draws lines first to last - 1
+	int last;
+	bool endOfFrame;
+	bool cgb;
+	uint64_t videoRamBlocks; //bit n set - block n of videoRam is in the job
+	bool hasSpriteTable;
+	uint8_t videoRam[NO_OF_VRAM_BANKS * VRAM_SIZE];
+	uint8_t spriteTable[SPRITE_RAM_SIZE];
+	struct scanlineState lines[Y];
+	uint16_t lineColours[Y][CGB_COLOURS]; //the lines' logged CGB colours, when cgb
+};
+
+struct renderThread {
+	pthread_t thread;
+	struct renderJob jobs[RENDER_QUEUE_LENGTH];
+	//on their own cache lines, as each is written by a different thread
+	_Alignas(64) _Atomic unsigned int head; //jobs submitted
+	_Alignas(64) _Atomic unsigned int tail; //jobs finished
+	_Atomic unsigned int framesRendered;
+	_Atomic bool stop;
+
+	//only touched by the emulation thread
+	_Alignas(64) unsigned int framesSubmitted;
+	unsigned int framesCollected;
+	int linesSubmitted; //of the frame in progress
+	uint64_t videoRamDirty; //blocks written since the last job
+	bool spriteTableChanged;
+
+	//only touched by the render thread
+	_Alignas(64) uint8_t videoRam[NO_OF_VRAM_BANKS * VRAM_SIZE];
+	uint8_t spriteTable[SPRITE_RAM_SIZE];
+	struct tileCache * tileCache;
+	struct spriteCache * spriteCache;
+	uint8_t frames[2][X * Y]; //frame N is drawn into frames[N % 2]
+	uint16_t frameColours[2][Y][CGB_COLOURS]; //with its line colours in CGB mode
+	uint64_t frameHashes[2][Y]; //and its line hashes
+};
+
+bool startRenderThread(struct gameboy * gameboy);
+void stopRenderThread(struct gameboy * gameboy);
+void submitLines(struct gameboy * gameboy, bool endOfFrame);
+bool collectFrame(struct gameboy * gameboy);
+//waits for the jobs submitted so far, then copies the frame into screen's
+//buffers as drawing inline would have it
+void copyRenderedLines(struct gameboy * gameboy, struct screen * screen);
+void markVideoRamDirty(struct gameboy * gameboy, uint16_t address);
+
+#endif
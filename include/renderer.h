@@ -0,0 +1,52 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+/*
+Draws logged scanlines into an index buffer. Everything the line renderer
+reads - VRAM, OAM and the tile/sprite caches built from them - comes through
+a renderer rather than the gameboy, so the same code can draw from the live
+memory on the emulation thread or from a snapshot on the render thread.
+
+In CGB mode the background takes its attributes (palette, tile bank, flips
+and priority) from the same tile map entry in VRAM bank 1, sprites are
+ordered by OAM index alone, and each line's colours are copied out beside
+the frame so they're converted with it.
+
+Each line drawn is hashed (with its colours on a CGB) into lineHashes, so the
+frame conversion can tell which lines changed without keeping the last frame
+around to compare against.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lcd.h"
+#include "memory.h"
+
+//CGB background attributes, from the tile map in VRAM bank 1. Sprites use
+//the same bits, except priority
+#define CGB_PALETTE_MASK 0x07
+#define CGB_TILE_BANK_BIT 3
+#define CGB_X_FLIP_BIT 5
+#define CGB_Y_FLIP_BIT 6
+#define CGB_PRIORITY_BIT 7
+
+struct renderer {
+	const uint8_t * videoRam[TOTAL_VRAM_PAGES]; //both banks, bank 1 after bank 0
+	const uint8_t * spriteTable;
+	struct tileCache * tileCache;
+	struct spriteCache * spriteCache;
+	uint8_t * indexBuffer;
+	uint16_t (*lineColours)[CGB_COLOURS];
+	const uint16_t (*loggedColours)[CGB_COLOURS]; //each logged line's CGB colours, NULL on a DMG
+	uint64_t * lineHashes; //one for each line of indexBuffer
+	bool cgb;
+};
+
+void renderLine(struct renderer * renderer, int line, const struct scanlineState * state);
+uint64_t hashLine(const uint8_t * pixels, const uint16_t * colours);
+struct tileCache * createTileCache(bool colourMode);
+void markTileRowDirty(struct tileCache * cache, int bank, uint16_t address);
+void markAllTilesDirty(struct tileCache * cache);
+struct spriteCache * createSpriteCache();
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ROMCACHE_H
+#define ROMCACHE_H
+
+#include <stdint.h>
+
+/*
+Process-wide cache of ROM images, keyed by a hash of their contents.
+
+When lots of instances run the same cart they all map the same read-only image
+instead of each holding their own copy. Every loadGame takes a reference, and
+the image is freed when the last instance holding it is unloaded/destroyed.
+*/
+
+struct romImage {
+	uint64_t hash;
+	uint32_t size;
+	int refCount;
+	uint8_t * data;
+	struct romImage * next;
+};
+
+//takes ownership of data. If an identical image is already cached, data is freed
+//and the cached image is returned instead. Returns NULL on failure.
+const struct romImage * acquireRomImage(uint8_t * data, uint32_t size);
+void retainRomImage(const struct romImage * image);
+void releaseRomImage(const struct romImage * image);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+/*
+Pixel art upscalers, run as a post-processing step on a finished frame.
+
+They work on the 2-bit shades in indexBuffer rather than on host colours:
+every scaler here only ever picks one of the source pixels, so comparing
+shades is all they need. The scaled shades are then converted to the host
+format on the way out with the same shade tables as the frame buffer, so the
+output goes straight into the caller's display or encode buffer.
+
+- SCALE_FILTER_NEAREST: every pixel becomes a factor x factor block
+- SCALE_FILTER_SCALE2X/SCALE3X: the AdvanceMAME edge rules, 2x and 3x
+- SCALE_FILTER_XBR: xBR's weighted edge detection at 2x. Each corner takes
+  the colour of a neighbour when the edge runs across it. There are no
+  blended colours, as there's no shade between two shades to blend to.
+  On CGB frames the edges are found from the colour indices, which only
+  roughly follow brightness.
+Larger factors run the filter again on its own output rather than enlarging
+it, the way AdvanceMAME builds Scale4x from Scale2x: each further 2 is
+another 2x pass (Scale2x, or xBR for xBR) and a 3 is a Scale3x pass. So
+Scale2x goes to 4x, 6x (then Scale3x) and 8x, Scale3x to 6x (then Scale2x)
+and xBR to 4x and 8x. Only nearest neighbour takes any factor.
+
+Each pass is split into bands of rows. The calling thread scales one band
+and a small pool of workers scales the rest, and a pass only starts once
+the whole of the one before it is done, as its edge rules read the rows
+around each band. The row kernels use SSE2 on x86.
+They're exported with their scalar versions so they can be benchmarked
+against each other.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "lcd.h"
+
+#define MAX_SCALE 8
+#define MAX_SCALE_PASSES 3 //8x is three 2x passes
+#define MAX_SCALER_WORKERS 8
+#define SCALE_PAD 2 //pixels of edge around the source, for the filters' neighbours
+#define SCALE_SOURCE_STRIDE (X + (2 * SCALE_PAD)) //of the first pass, later ones are wider
+
+enum scaleFilter {
+	SCALE_FILTER_NEAREST,
+	SCALE_FILTER_SCALE2X,
+	SCALE_FILTER_SCALE3X,
+	SCALE_FILTER_XBR
+};
+
+struct scaler;
+
+struct scalerWorker {
+	struct scaler * scaler;
+	pthread_t thread;
+	int band; //scales this band of every pass, of workerCount + 1
+	uint8_t filtered[3][X * MAX_SCALE];
+	uint8_t expanded[X * MAX_SCALE];
+};
+
+struct scalePass {
+	//rows[2] is the source row, rows[0] to rows[4] the rows 2 above to 2
+	//below, each readable SCALE_PAD pixels either side. Writes one output row
+	//per unit of the pass's factor
+	void (*scaleRow)(const uint8_t * const * rows, int count, uint8_t * const * out);
+	int factor;
+	int width; //of the pass's source
+	int height;
+	uint8_t * source; //shades, edges repeated. Earlier passes write into it
+};
+
+struct scaler {
+	enum scaleFilter filter;
+	int factor;
+	struct scalePass passes[MAX_SCALE_PASSES];
+	int passCount;
+	int multiple; //nearest neighbour enlarges the last pass by this much
+	int workerCount;
+	struct scalerWorker workers[MAX_SCALER_WORKERS + 1]; //the last is the calling thread
+
+	//the frame being scaled
+	const struct screen * screen;
+	uint8_t * out;
+	int pitch;
+	int pass; //the one the workers are running
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation; //frames handed to the workers
+	int pending; //workers still scaling this frame
+	bool stop;
+};
+
+struct scaler * createScaler(enum scaleFilter filter, int factor, int workers);
+void destroyScaler(struct scaler * scaler);
+void scaleFrame(struct scaler * scaler, const struct screen * screen, uint8_t * out, int pitch);
+
+void scaleNearestRow(const uint8_t * const * rows, int count, uint8_t * const * out);
+void scale2xRow(const uint8_t * const * rows, int count, uint8_t * const * out);
+void scale3xRow(const uint8_t * const * rows, int count, uint8_t * const * out);
+void scaleXBRRow(const uint8_t * const * rows, int count, uint8_t * const * out);
+
+void scale2xRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out);
+void scale3xRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out);
+void scaleXBRRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TILE_DECODE_H
+#define TILE_DECODE_H
+
+/*
+Pixel kernels shared by the renderers.
+
+Tiles are stored as 2 bits per pixel in two bitplanes - each row of 8 pixels is
+2 bytes, the first holding bit 0 of every colour ID and the second bit 1, with
+the leftmost pixel in bit 7. decodeTileRow turns a row into 8 colour IDs (0-3).
+
+mapScanline* turn a line of 2-bit shade indices into output pixels through a
+4 entry shade table, e.g. the host colours after the palette has been applied.
+mapScanline16 does the same for 16 bit pixels, such as RGB565.
+
+On x86 the decoder uses SSE2 and the scanline mappers use SSSE3 byte shuffles
+when the CPU has them, otherwise everything falls back to the scalar versions.
+The scalar versions are also exported so they can be benchmarked against.
+*/
+
+#include <stdint.h>
+
+struct colour;
+
+void decodeTileRow(uint8_t low, uint8_t high, uint8_t * colourIds);
+void mapScanlineRGB(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out);
+void mapScanlineRGBA(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out);
+void mapScanline16(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out);
+
+void decodeTileRowScalar(uint8_t low, uint8_t high, uint8_t * colourIds);
+void mapScanlineRGBScalar(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out);
+void mapScanlineRGBAScalar(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out);
+void mapScanline16Scalar(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out);
+
+#endif
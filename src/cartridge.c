@@ -1,19 +1,22 @@
 #include "../include/cartridge.h"
 #include "../include/gameboy.h"
 #include "../include/mbc.h"
+#include "../include/bitUtils.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-struct romInfo romInfoChoices[0x54];
-struct ramInfo ramInfoChoices[0x03];
+struct romInfo romInfoChoices[NO_OF_ROM_SIZE_CODES];
+struct ramInfo ramInfoChoices[NO_OF_RAM_SIZE_CODES];
 char * locales[0x2];
 
 static bool isValidGame(const char * directory);
 static void initialiseRomBankChoices();
 static void initialiseRamBankChoices();
 static void initialiseLocaleChoices();
+static uint8_t * readGame(FILE * game, uint32_t * size);
+static void allocateRamBanks(struct gameboy * gameboy);
 
 void loadGame(struct gameboy * gameboy, const char * directory)
 {
@@ -31,24 +34,125 @@ void loadGame(struct gameboy * gameboy, const char * directory)
 		exit(-1); //implement better error handling system
 	}
 
-	fread(gameboy->cartridge.memory, 1, MAX_CART_SIZE, game);
+	unloadGame(gameboy);
+	uint32_t size = 0;
+	uint8_t * rom = readGame(game, &size);
 	fclose(game);
-	//load first 0x8000 into gameboy memory - do this with MBC functionality
-	//memcpy(&gameboy->memory.mem, &gameboy->cartridge.memory, CARTRIDGE_SIZE);
+	if (rom == NULL){
+		fprintf(stderr, "Game at %s cannot be read.\n", directory);
+		destroyGameboy(gameboy);
+		exit(-1);
+	}
+	//the image is never copied into gameboy memory - the MBC maps it in
+	const struct romImage * image = acquireRomImage(rom, size);
+	if (image == NULL){
+		fprintf(stderr, "Game at %s cannot be read.\n", directory);
+		destroyGameboy(gameboy);
+		exit(-1);
+	}
+	gameboy->cartridge.romImage = image;
+	gameboy->cartridge.memory = image->data;
+	gameboy->cartridge.memorySize = image->size;
 
 	loadBankType(gameboy);
 	loadRomInfo(gameboy);
 	loadRamInfo(gameboy);
 	loadLocaleInfo(gameboy);
+	loadColourMode(gameboy);
+	allocateRamBanks(gameboy);
 
 	initialiseRomBanks(gameboy); 
 
 	printf("done.\n");
+
+	//the registers and memory start up differently in colour mode
+	reset(gameboy);
 	
 	printCartDetails(gameboy);
 
 }
 
+void unloadGame(struct gameboy * gameboy)
+{
+	//patched ROM pages belong to the game being unloaded
+	clearCheats(gameboy);
+	releaseRomImage(gameboy->cartridge.romImage);
+	if (gameboy->cartridge.ramPages != NULL){
+		for (int i = 0; i < gameboy->cartridge.ramBankCount * PAGES_PER_RAM_BANK; i++){
+			releasePage(gameboy->cartridge.ramPages[i]);
+		}
+		free(gameboy->cartridge.ramPages);
+	}
+	gameboy->cartridge.romImage = NULL;
+	gameboy->cartridge.memory = NULL;
+	gameboy->cartridge.memorySize = 0;
+	gameboy->cartridge.ramPages = NULL;
+	gameboy->cartridge.romBankCount = 0;
+	gameboy->cartridge.ramBankCount = 0;
+	gameboy->cartridge.cgb = false;
+	setColourFrames(gameboy, false);
+	freeColourBanks(gameboy);
+	initialiseMemoryMap(gameboy);
+}
+
+static uint8_t * readGame(FILE * game, uint32_t * size)
+{
+	if (fseek(game, 0, SEEK_END) != 0){
+		return NULL;
+	}
+	long fileSize = ftell(game);
+	rewind(game);
+	if (fileSize <= 0){
+		return NULL;
+	}
+
+	//round up to whole banks (at least two) so bank mapping never runs off the end
+	uint32_t banks = (fileSize + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE;
+	if (banks < 2){
+		banks = 2;
+	}
+	*size = banks * ROM_BANK_SIZE;
+	uint8_t * rom = calloc(*size, 1);
+	if (rom == NULL){
+		return NULL;
+	}
+
+	if (fread(rom, 1, fileSize, game) != (size_t)fileSize){
+		free(rom);
+		return NULL;
+	}
+	return rom;
+}
+
+static void allocateRamBanks(struct gameboy * gameboy)
+{
+	//only carts that have external RAM pay for it
+	if (gameboy->cartridge.ramSize == 0){
+		gameboy->cartridge.ramPages = NULL;
+		gameboy->cartridge.ramBankCount = 0;
+		return;
+	}
+	if (gameboy->cartridge.ramBankCount == 0){
+		gameboy->cartridge.ramBankCount = 1;
+	}
+
+	int noOfPages = gameboy->cartridge.ramBankCount * PAGES_PER_RAM_BANK;
+	gameboy->cartridge.ramPages = calloc(noOfPages, sizeof(struct page *));
+	if (gameboy->cartridge.ramPages == NULL){
+		fprintf(stderr, "Couldn't allocate cartridge RAM.\n");
+		destroyGameboy(gameboy);
+		exit(-1);
+	}
+	for (int i = 0; i < noOfPages; i++){
+		gameboy->cartridge.ramPages[i] = allocatePage();
+		if (gameboy->cartridge.ramPages[i] == NULL){
+			fprintf(stderr, "Couldn't allocate cartridge RAM.\n");
+			destroyGameboy(gameboy);
+			exit(-1);
+		}
+	}
+}
+
 void loadBankType(struct gameboy * gameboy)
 {
 	gameboy->cartridge.bankMode = gameboy->cartridge.memory[MBC_MODE_ADDRESS];
@@ -60,8 +164,14 @@ void loadRomInfo(struct gameboy * gameboy)
 {
 	initialiseRomBankChoices();
 	uint8_t bankCode = gameboy->cartridge.memory[ROM];
-	gameboy->cartridge.romBankCount = romInfoChoices[bankCode].noOfBanks;
+	if (bankCode >= NO_OF_ROM_SIZE_CODES){
+		fprintf(stderr, "Unknown ROM size code %02X in the cartridge header.\n", bankCode);
+		destroyGameboy(gameboy);
+		exit(-1);
+	}
 	gameboy->cartridge.romSize = romInfoChoices[bankCode].size;
+	//bank switching wraps around whatever was actually loaded, not what the header claims
+	gameboy->cartridge.romBankCount = gameboy->cartridge.memorySize / ROM_BANK_SIZE;
 }
 
 static void initialiseRomBankChoices()
@@ -103,6 +213,8 @@ static void initialiseRamBankChoices()
 	ramInfoChoices[0x03].noOfBanks = 4;
 	ramInfoChoices[0x04].size = 131072;
 	ramInfoChoices[0x04].noOfBanks = 16;
+	ramInfoChoices[0x05].size = 65536;
+	ramInfoChoices[0x05].noOfBanks = 8;
 	
 }
 
@@ -110,6 +222,11 @@ void loadRamInfo(struct gameboy * gameboy)
 {
 	initialiseRamBankChoices();
 	uint8_t bankCode = gameboy->cartridge.memory[EXTERNAL_RAM];
+	if (bankCode >= NO_OF_RAM_SIZE_CODES){
+		fprintf(stderr, "Unknown RAM size code %02X in the cartridge header.\n", bankCode);
+		destroyGameboy(gameboy);
+		exit(-1);
+	}
         gameboy->cartridge.ramBankCount = ramInfoChoices[bankCode].noOfBanks;
         gameboy->cartridge.ramSize = ramInfoChoices[bankCode].size;
 	
@@ -122,6 +239,22 @@ void loadLocaleInfo(struct gameboy * gameboy)
 	gameboy->cartridge.locale = locales[localeCode];
 }
 
+void loadColourMode(struct gameboy * gameboy)
+{
+	//colour games run in CGB mode, everything else as on a DMG
+	gameboy->cartridge.cgb = isBitSet(gameboy->cartridge.memory[CGB_FLAG], CGB_SUPPORT_BIT);
+	if (gameboy->cartridge.cgb){
+		//only colour games pay for the second VRAM bank and the other 6 work RAM banks
+		if (!allocateColourBanks(gameboy) || !setColourFrames(gameboy, true)){
+			fprintf(stderr, "Couldn't allocate Game Boy Color memory.\n");
+			destroyGameboy(gameboy);
+			exit(-1);
+		}
+		//the pixel FIFO only draws DMG frames
+		setRenderMode(gameboy, RENDER_SCANLINE);
+	}
+}
+
 static void initialiseLocaleChoices()
 {
 	locales[0] = "Japanese";
@@ -141,6 +274,7 @@ void printCartDetails(struct gameboy * gameboy)
 	printf("\tROM size: %d bytes\n", gameboy->cartridge.romSize);
 	printf("\tRAM size: %d bytes\n", gameboy->cartridge.ramSize);
 	printf("\tLocale: %s\n", gameboy->cartridge.locale);
+	printf("\tMode: %s\n", gameboy->cartridge.cgb ? "Game Boy Color" : "Game Boy");
 
 }
 
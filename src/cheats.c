@@ -0,0 +1,271 @@
+#include "../include/cheats.h"
+#include "../include/gameboy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define GAME_GENIE_SHORT_LENGTH 6
+#define GAME_GENIE_LONG_LENGTH 9
+#define GAMESHARK_LENGTH 8
+#define GAME_GENIE_COMPARE_XOR 0xBA
+#define GAMESHARK_START EX_RAM_START
+#define GAMESHARK_END (ECHO_RAM_START_UPPER - 1)
+#define GAMESHARK_TYPE_MASK 0xF0
+#define GAMESHARK_BANK_MASK 0x0F
+#define GAMESHARK_EXTERNAL_BANK 0x80
+#define GAMESHARK_WORK_RAM_BANK 0x90
+
+static int parseHexDigits(const char * code, uint8_t * digits, int maxDigits);
+static bool rebuildPatchedPages(struct gameboy * gameboy);
+static bool patchROMByte(struct gameboy * gameboy, const struct gameGenieCode * code, uint32_t romOffset);
+static struct page * getPatchedPage(struct gameboy * gameboy, uint32_t romOffset);
+static void releasePatchedPages(struct gameboy * gameboy);
+
+bool addGameGenieCode(struct gameboy * gameboy, const char * code)
+{
+	struct cheats * cheats = &gameboy->cheats;
+	if ((cheats->noOfGameGenieCodes == MAX_GAME_GENIE_CODES) || (gameboy->cartridge.memory == NULL)){
+		return false;
+	}
+
+	uint8_t d[GAME_GENIE_LONG_LENGTH];
+	int length = parseHexDigits(code, d, GAME_GENIE_LONG_LENGTH);
+	if ((length != GAME_GENIE_SHORT_LENGTH) && (length != GAME_GENIE_LONG_LENGTH)){
+		return false;
+	}
+
+	//ABC-DEF-GHI
+	struct gameGenieCode genie;
+	genie.data = (d[0] << 4) | d[1];
+	genie.address = ((d[5] ^ 0xF) << 12) | (d[2] << 8) | (d[3] << 4) | d[4];
+	genie.hasCompare = (length == GAME_GENIE_LONG_LENGTH);
+	genie.compare = 0;
+	if (genie.hasCompare){
+		uint8_t compare = (d[6] << 4) | d[8];
+		compare = (compare >> 2) | (compare << 6); //rotate right 2
+		genie.compare = compare ^ GAME_GENIE_COMPARE_XOR;
+	}
+
+	if (genie.address >= CARTRIDGE_SIZE){
+		return false;
+	}
+
+	cheats->gameGenie[cheats->noOfGameGenieCodes++] = genie;
+	if (!rebuildPatchedPages(gameboy)){
+		cheats->noOfGameGenieCodes--;
+		rebuildPatchedPages(gameboy);
+		return false;
+	}
+	return true;
+}
+
+bool addGameSharkCode(struct gameboy * gameboy, const char * code)
+{
+	struct cheats * cheats = &gameboy->cheats;
+	if (cheats->noOfGameSharkCodes == MAX_GAMESHARK_CODES){
+		return false;
+	}
+
+	uint8_t d[GAMESHARK_LENGTH];
+	if (parseHexDigits(code, d, GAMESHARK_LENGTH) != GAMESHARK_LENGTH){
+		return false;
+	}
+
+	//ttvvllhh
+	struct gameSharkCode shark;
+	shark.type = (d[0] << 4) | d[1];
+	shark.data = (d[2] << 4) | d[3];
+	shark.address = (d[6] << 12) | (d[7] << 8) | (d[4] << 4) | d[5];
+
+	if ((shark.address < GAMESHARK_START) || (shark.address > GAMESHARK_END)){
+		return false;
+	}
+	//a bank has to be one the address is in
+	uint8_t bankType = shark.type & GAMESHARK_TYPE_MASK;
+	if ((bankType == GAMESHARK_EXTERNAL_BANK) && (shark.address > RAM_BANK_END)){
+		return false;
+	}
+	if ((bankType == GAMESHARK_WORK_RAM_BANK) && ((shark.address < WORK_RAM_START + PAGE_SIZE)
+		|| ((shark.type & GAMESHARK_BANK_MASK) >= NO_OF_WORK_RAM_BANKS))){
+		return false;
+	}
+
+	cheats->gameShark[cheats->noOfGameSharkCodes++] = shark;
+	return true;
+}
+
+void clearCheats(struct gameboy * gameboy)
+{
+	gameboy->cheats.noOfGameGenieCodes = 0;
+	gameboy->cheats.noOfGameSharkCodes = 0;
+	releasePatchedPages(gameboy);
+	mapROMBank(gameboy);
+}
+
+void applyGameSharkCodes(struct gameboy * gameboy)
+{
+	//called on entering vblank, once a frame. The codes go straight into the
+	//RAM bank, so they never reach the MBC or need the RAM enabled
+	struct cheats * cheats = &gameboy->cheats;
+	for (int i = 0; i < cheats->noOfGameSharkCodes; i++){
+		const struct gameSharkCode * code = &cheats->gameShark[i];
+		uint8_t bank;
+		switch (code->type & GAMESHARK_TYPE_MASK){
+			case GAMESHARK_EXTERNAL_BANK:
+			case GAMESHARK_WORK_RAM_BANK:
+				bank = code->type & GAMESHARK_BANK_MASK;
+				break;
+			default:
+				//whichever bank the game has switched in
+				bank = (code->address <= RAM_BANK_END) ? gameboy->cartridge.currentRAMBank : gameboy->memory.workRamBank;
+				break;
+		}
+		writeRAMBank(gameboy, code->address, bank, code->data);
+	}
+}
+
+void mapPatchedPages(struct gameboy * gameboy)
+{
+	//swap any freshly mapped ROM page that has a patched shadow for the shadow.
+	//Only called from mapROMBank, so this runs on bank switches, not on reads
+	struct cheats * cheats = &gameboy->cheats;
+	const uint8_t * rom = gameboy->cartridge.memory;
+	if ((rom == NULL) || (cheats->noOfPatchedPages == 0)){
+		return;
+	}
+
+	for (int index = 0; index < (CARTRIDGE_SIZE >> PAGE_SHIFT); index++){
+		uint32_t romOffset = gameboy->memory.readMap[index] - rom;
+		for (int i = 0; i < cheats->noOfPatchedPages; i++){
+			if (cheats->patchedPages[i].romOffset == romOffset){
+				gameboy->memory.readMap[index] = cheats->patchedPages[i].page->data;
+				break;
+			}
+		}
+	}
+}
+
+bool shareCheats(struct gameboy * parent, struct gameboy * child)
+{
+	//patched pages are never written after they're built, so children can
+	//just hold another reference to them
+	int count = parent->cheats.noOfPatchedPages;
+	child->cheats.patchedPages = NULL;
+	if (count == 0){
+		return true;
+	}
+
+	child->cheats.patchedPages = malloc(count * sizeof(struct patchedPage));
+	if (child->cheats.patchedPages == NULL){
+		child->cheats.noOfPatchedPages = 0;
+		return false;
+	}
+	memcpy(child->cheats.patchedPages, parent->cheats.patchedPages, count * sizeof(struct patchedPage));
+	for (int i = 0; i < count; i++){
+		atomic_fetch_add(&child->cheats.patchedPages[i].page->refCount, 1);
+	}
+	return true;
+}
+
+static int parseHexDigits(const char * code, uint8_t * digits, int maxDigits)
+{
+	//dashes (and spaces) are just for readability
+	int length = 0;
+	for (const char * c = code; *c != '\0'; c++){
+		if ((*c == '-') || (*c == ' ')){
+			continue;
+		}
+		if (length == maxDigits){
+			return -1;
+		}
+
+		if ((*c >= '0') && (*c <= '9')){
+			digits[length++] = *c - '0';
+		}
+		else if ((*c >= 'A') && (*c <= 'F')){
+			digits[length++] = *c - 'A' + 10;
+		}
+		else if ((*c >= 'a') && (*c <= 'f')){
+			digits[length++] = *c - 'a' + 10;
+		}
+		else {
+			return -1;
+		}
+	}
+	return length;
+}
+
+static bool rebuildPatchedPages(struct gameboy * gameboy)
+{
+	releasePatchedPages(gameboy);
+
+	struct cheats * cheats = &gameboy->cheats;
+	bool success = true;
+	for (int i = 0; (i < cheats->noOfGameGenieCodes) && success; i++){
+		const struct gameGenieCode * code = &cheats->gameGenie[i];
+		if (code->address < MBANK_START){
+			success = patchROMByte(gameboy, code, code->address);
+		}
+		else {
+			//a banked address could be in any bank - the compare value decides
+			for (int bank = 1; (bank < gameboy->cartridge.romBankCount) && success; bank++){
+				uint32_t romOffset = (bank * ROM_BANK_SIZE) + (code->address - MBANK_START);
+				success = patchROMByte(gameboy, code, romOffset);
+			}
+		}
+	}
+
+	mapROMBank(gameboy);
+	return success;
+}
+
+static bool patchROMByte(struct gameboy * gameboy, const struct gameGenieCode * code, uint32_t romOffset)
+{
+	if (code->hasCompare && (gameboy->cartridge.memory[romOffset] != code->compare)){
+		return true;
+	}
+
+	struct page * page = getPatchedPage(gameboy, romOffset & ~PAGE_MASK);
+	if (page == NULL){
+		return false;
+	}
+	page->data[romOffset & PAGE_MASK] = code->data;
+	return true;
+}
+
+static struct page * getPatchedPage(struct gameboy * gameboy, uint32_t romOffset)
+{
+	struct cheats * cheats = &gameboy->cheats;
+	for (int i = 0; i < cheats->noOfPatchedPages; i++){
+		if (cheats->patchedPages[i].romOffset == romOffset){
+			return cheats->patchedPages[i].page;
+		}
+	}
+
+	struct patchedPage * patchedPages = realloc(cheats->patchedPages, (cheats->noOfPatchedPages + 1) * sizeof(struct patchedPage));
+	if (patchedPages == NULL){
+		return NULL;
+	}
+	cheats->patchedPages = patchedPages;
+
+	struct page * page = allocatePage();
+	if (page == NULL){
+		return NULL;
+	}
+	memcpy(page->data, &gameboy->cartridge.memory[romOffset], PAGE_SIZE);
+	cheats->patchedPages[cheats->noOfPatchedPages].romOffset = romOffset;
+	cheats->patchedPages[cheats->noOfPatchedPages].page = page;
+	cheats->noOfPatchedPages++;
+	return page;
+}
+
+static void releasePatchedPages(struct gameboy * gameboy)
+{
+	struct cheats * cheats = &gameboy->cheats;
+	for (int i = 0; i < cheats->noOfPatchedPages; i++){
+		releasePage(cheats->patchedPages[i].page);
+	}
+	free(cheats->patchedPages);
+	cheats->patchedPages = NULL;
+	cheats->noOfPatchedPages = 0;
+}
@@ -604,7 +604,7 @@ void executeNextOpcode(struct gameboy * gameboy)
 
 	if (opcode != 0xCB){
 		//if opcode wasn't extended, add cycles
-		gameboy->cpu.cycles += instruction.cycles;
+		gameboy->cpu.cycles += gameboy->cpu.doubleSpeed ? instruction.cycles / 2 : instruction.cycles;
 	}
 
 	count++;
@@ -733,6 +733,12 @@ void rrc_a(struct gameboy * gameboy)
 
 void stop(struct gameboy * gameboy) //0x10
 {
+	//on a CGB with a speed switch armed, STOP changes speed rather than stopping
+	if (gameboy->cartridge.cgb && gameboy->cpu.speedSwitchArmed){
+		gameboy->cpu.doubleSpeed = !gameboy->cpu.doubleSpeed;
+		gameboy->cpu.speedSwitchArmed = false;
+		return;
+	}
 	printf("STOP - need to implement\n");
 }
 
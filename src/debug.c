@@ -24,9 +24,10 @@ void printDebugTrace(struct gameboy * gameboy)
 	printf("\tScroll X: %x\n", gameboy->screen.scrollX);
 	printf("\tScroll Y: %x\n", gameboy->screen.scrollY);
 	printf("\tCurrent Scanline: %x\n", gameboy->screen.currentScanline);
-	printf("\tScanline Counter: %x\n", gameboy->screen.scanlineCounter);
-	printf("\tWindow X: %x\n", gameboy->screen.windowXPos);
-	printf("\tWindow Y: %x\n", gameboy->screen.windowYPos);
+	printf("\tNext LCD Event: %d\n", gameboy->screen.nextEventCycle);
+	printf("\tWindow X: %x\n", gameboy->memory.io[WINDOW_POS_X - IO_START]);
+	printf("\tWindow Y: %x\n", gameboy->memory.io[WINDOW_POS_Y - IO_START]);
+	printf("\tWindow Line: %d\n", gameboy->screen.windowLine);
 
 	printf("\n");
 	printf("--INTERRUPTS--\n");
@@ -36,7 +37,7 @@ void printDebugTrace(struct gameboy * gameboy)
 	
 	printf("\n");
 	printf("--TIMERS--\n");
-	printf("\tTMA: %x\n", gameboy->memory.mem[TMA]);
-	printf("\tTIMA: %x\n", gameboy->memory.mem[TIMA]);
-	printf("\tDivider Register: %x\n", gameboy->memory.mem[DIV_REG]);
+	printf("\tTMA: %x\n", gameboy->memory.io[TMA - IO_START]);
+	printf("\tTIMA: %x\n", gameboy->memory.io[TIMA - IO_START]);
+	printf("\tDivider Register: %x\n", gameboy->memory.io[DIV_REG - IO_START]);
 }
@@ -1,6 +1,32 @@
 #include "../include/display.h"
 #include "../include/gameboy.h"
+#include "../include/keyboard.h"
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void * runPresenter(void * arg);
+static void pollEvents();
+static void renderGraphics(struct presentedFrame * frame);
+static void allocateTexture();
+static void drawFrameQuad();
+
+static struct presenter presenter;
+//emulation thread only
+static uint8_t appliedButtons; //as last passed to the joypad
+static uint64_t publishedHashes[Y]; //the line hashes of the last frame passed on
+static const struct colour * publishedShades; //and its shades
+static bool published;
+
+//presenter thread only
+static struct scaler * scaler;
+static GLuint texture;
+static GLuint pixelBuffers[DISPLAY_PIXEL_BUFFERS];
+static int nextPixelBuffer;
 
 static void initialiseSDL()
 {
@@ -35,21 +61,238 @@ static void initialiseOpenGL()
 
 }
 
+static bool getGLFormat(enum pixelFormat pixelFormat, GLenum * format, GLenum * type)
+{
+	switch (pixelFormat){
+		case PIXEL_FORMAT_RGB888:
+			*format = GL_RGB;
+			*type = GL_UNSIGNED_BYTE;
+			return true;
+		case PIXEL_FORMAT_RGBA8888:
+			*format = GL_RGBA;
+			*type = GL_UNSIGNED_BYTE;
+			return true;
+		case PIXEL_FORMAT_BGRA8888:
+			*format = GL_BGRA;
+			*type = GL_UNSIGNED_BYTE;
+			return true;
+		case PIXEL_FORMAT_RGB565:
+			*format = GL_RGB;
+			*type = GL_UNSIGNED_SHORT_5_6_5;
+			return true;
+		default:
+			return false;
+	}
+}
+
+void startEmulationLoop(struct gameboy * gameboy)
+{
+	//input and drawing are on the display thread - nothing here waits on it
+	bool quit = false;
+	while(!quit){
+		quit = pollDisplayInput(gameboy);
+		update(gameboy); //call this 60 times a second
+	}
+
+	stopDisplay();
+
+}
+
+void update(struct gameboy * gameboy)
+{
+	static int frame;
+	clock_t start = clock();
+	runFrame(gameboy);
+	//skipped frames have nothing new to show
+	if (takeFrame(gameboy)){
+		publishFrame(gameboy);
+	}
+	float elapsedSecs = (float)(clock() - start)/CLOCKS_PER_SEC;
+	float remainingFrameTime = (1/(float)FPS) - elapsedSecs;
+	setHostBehind(gameboy, remainingFrameTime < 0);
+	const struct timespec req = {0, remainingFrameTime * 1000000000L};
+	nanosleep(&req, NULL);
+	++frame;
+	//printf("frame: %d\n", frame);
+	if (frame % 60 == 0){
+		printf("frame %d, %f\n", frame, (remainingFrameTime + elapsedSecs));
+		printf("elapsed secs: %f\n", elapsedSecs);
+	}
+	
+}
+
 void startDisplay()
+{
+	//SDL and GL are set up on the presenter thread, as the GL context belongs
+	//to the thread that creates it
+	presenter.back = 0;
+	presenter.middle = 1;
+	presenter.front = 2;
+	if (pthread_create(&presenter.thread, NULL, runPresenter, NULL) != 0){
+		fprintf(stderr, "Couldn't start the display thread.\n");
+		exit(-1);
+	}
+}
+
+void stopDisplay()
+{
+	atomic_store(&presenter.stop, true);
+	pthread_join(presenter.thread, NULL);
+}
+
+void publishFrame(struct gameboy * gameboy)
+{
+	//called on the emulation thread for each drawn frame. When every line
+	//hashes the same as the last frame passed on (and the shades are the
+	//same), that frame is already on screen
+	struct screen * screen = &gameboy->screen;
+	if (published && (screen->palettes.shades == publishedShades) && (memcmp(screen->lineHashes, publishedHashes, sizeof(publishedHashes)) == 0)){
+		return;
+	}
+	memcpy(publishedHashes, screen->lineHashes, sizeof(publishedHashes));
+	publishedShades = screen->palettes.shades;
+	published = true;
+
+	struct presentedFrame * frame = &presenter.frames[presenter.back];
+	frame->colourFrames = screen->colourFrames;
+	frame->palettes = screen->palettes;
+	memcpy(frame->indices, screen->indexBuffer, X * Y);
+	if (frame->colourFrames){
+		memcpy(frame->lineColours, screen->lineColours, sizeof(frame->lineColours));
+	}
+	int middle = atomic_exchange_explicit(&presenter.middle, presenter.back | PRESENT_FRESH, memory_order_acq_rel);
+	presenter.back = middle & PRESENT_INDEX_MASK;
+}
+
+bool pollDisplayInput(struct gameboy * gameboy)
+{
+	//the presenter polls SDL, this just passes on what it saw. Returns true
+	//once the user has asked to quit
+	uint8_t held = atomic_load_explicit(&presenter.heldButtons, memory_order_relaxed);
+	if (held != appliedButtons){
+		setHeldButtons(gameboy, held);
+		appliedButtons = held;
+	}
+	return atomic_load_explicit(&presenter.quit, memory_order_relaxed);
+}
+
+static void * runPresenter(void * arg)
 {
 	initialiseSDL();
 	initialiseOpenGL();
+	scaler = createScaler(DISPLAY_FILTER, DISPLAY_SCALE, DISPLAY_SCALER_WORKERS);
+	if (scaler == NULL){
+		fprintf(stderr, "Couldn't create the display scaler.\n");
+		exit(-1);
+	}
+	glGenTextures(1, &texture);
+	glGenBuffers(DISPLAY_PIXEL_BUFFERS, pixelBuffers);
+	allocateTexture();
+
+	while (!atomic_load(&presenter.stop)){
+		pollEvents();
+		if (!(atomic_load_explicit(&presenter.middle, memory_order_relaxed) & PRESENT_FRESH)){
+			const struct timespec idle = {0, PRESENT_IDLE_NS};
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		int middle = atomic_exchange_explicit(&presenter.middle, presenter.front, memory_order_acq_rel);
+		presenter.front = middle & PRESENT_INDEX_MASK;
+		renderGraphics(&presenter.frames[presenter.front]);
+	}
+
+	glDeleteBuffers(DISPLAY_PIXEL_BUFFERS, pixelBuffers);
+	glDeleteTextures(1, &texture);
+	destroyScaler(scaler);
+	SDL_Quit();
+	return NULL;
 }
 
-void renderGraphics(struct gameboy * gameboy)
+static void pollEvents()
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glLoadIdentity();
-	glRasterPos2i(-1, 1);
-	glPixelZoom(1, -1);
-	//glDrawPixels(X, Y, GL_RGB, GL_UNSIGNED_BYTE, gameboy->screen.frameBuffer);
-	//glDrawPixels(X, Y, GL_RGB, GL_UNSIGNED_BYTE, gameboy->screen.frameBuffer3D);
-	glDrawPixels(X, Y, GL_RGB, GL_UNSIGNED_BYTE, gameboy->screen.frameBufferNew);
+	SDL_Event event;
+	while (SDL_PollEvent(&event)){
+		Uint8 * keys = SDL_GetKeyState(NULL);
+		if (keys[SDLK_ESCAPE] || (event.type == SDL_QUIT)){
+			atomic_store(&presenter.quit, true);
+		}
+		if ((event.type == SDL_KEYUP) || (event.type == SDL_KEYDOWN)){
+			atomic_store_explicit(&presenter.heldButtons, getHeldButtons(keys), memory_order_relaxed);
+		}
+	}
+}
+
+static void renderGraphics(struct presentedFrame * frame)
+{
+	//the scaler converts from a screen, so the frame is dressed up as one in
+	//the texture's format
+	struct screen screen = {
+		.pixelFormat = DISPLAY_PIXEL_FORMAT,
+		.colourFrames = frame->colourFrames,
+		.palettes = frame->palettes,
+		.indexBuffer = frame->indices,
+		.lineColours = frame->lineColours
+	};
+	buildHostShades(&screen);
+	GLenum format, type;
+	getGLFormat(DISPLAY_PIXEL_FORMAT, &format, &type);
+
+	//the frame is scaled straight into a pixel buffer. Orphaning it first
+	//means mapping never waits for the GPU to finish reading the last frame
+	//out of it, and alternating between two keeps the driver from having to
+	//find a new block every frame
+	int pitch = DISPLAY_X * getBytesPerPixel(screen.pixelFormat);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[nextPixelBuffer]);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, pitch * DISPLAY_Y, NULL, GL_STREAM_DRAW);
+	uint8_t * pixels = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	if (pixels != NULL){
+		scaleFrame(scaler, &screen, pixels, pitch);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		//with a buffer bound, the upload is queued as a copy on the GPU's side
+		//rather than read from our memory before this returns
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DISPLAY_X, DISPLAY_Y, format, type, NULL);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	nextPixelBuffer = (nextPixelBuffer + 1) % DISPLAY_PIXEL_BUFFERS;
+
+	//the quad covers the whole window, so there's nothing to clear
+	drawFrameQuad();
 	SDL_GL_SwapBuffers();
 }
 
+static void allocateTexture()
+{
+	//the texture is the size of the scaled frame, so it's drawn 1:1
+	GLenum format, type;
+	if (!getGLFormat(DISPLAY_PIXEL_FORMAT, &format, &type)){
+		fprintf(stderr, "The display can't upload its pixel format.\n");
+		exit(-1);
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLint internalFormat = (format == GL_RGB) ? GL_RGB8 : GL_RGBA8;
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, DISPLAY_X, DISPLAY_Y, 0, format, type, NULL);
+}
+
+static void drawFrameQuad()
+{
+	//the projection has y going down, like the frame's rows
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0);
+	glVertex2i(0, 0);
+	glTexCoord2f(1, 0);
+	glVertex2i(DISPLAY_X, 0);
+	glTexCoord2f(1, 1);
+	glVertex2i(DISPLAY_X, DISPLAY_Y);
+	glTexCoord2f(0, 1);
+	glVertex2i(0, DISPLAY_Y);
+	glEnd();
+}
+
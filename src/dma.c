@@ -1,11 +1,173 @@
 #include "../include/dma.h"
 #include "../include/gameboy.h"
+#include "../include/bitUtils.h"
+#include <string.h>
+
+static void startAccurateTransfer(struct gameboy * gameboy, uint16_t source);
+static void finishTransfer(struct gameboy * gameboy);
+static void copyBlock(struct gameboy * gameboy, uint16_t source);
+static void copyHDMABlock(struct gameboy * gameboy);
+
+void initialiseDMA(struct gameboy * gameboy)
+{
+	//fast mode is the default - games run a DMA every frame
+	gameboy->dma.mode = DMA_FAST;
+	finishTransfer(gameboy);
+	gameboy->dma.hdmaActive = false;
+	gameboy->dma.hdmaBlocksLeft = 0;
+}
+
+void setDMAMode(struct gameboy * gameboy, enum dmaMode mode)
+{
+	//don't leave a half finished transfer behind when switching modes
+	if (gameboy->dma.active){
+		copyBlock(gameboy, gameboy->dma.source);
+		finishTransfer(gameboy);
+	}
+	gameboy->dma.mode = mode;
+}
 
 void doDMATransfer(struct gameboy * gameboy, uint8_t data)
 {
-	uint16_t address = data << 8; //data * 100
-	for (int i = SPRITE_RAM_START; i < 0xA0; i++){
-		uint8_t byte = readByte(gameboy, address + i);
-		writeByte(gameboy, i, byte);
+	uint16_t source = data << 8; //data * 0x100
+	//OAM and I/O aren't on the DMA's bus - FE00-FFFF reads the work RAM
+	//they'd echo (DE00-DFFF), the way E000-FDFF does. So OAM is never
+	//copied onto itself
+	if (source >= SPRITE_RAM_START){
+		source -= ECHO_OFFSET;
+	}
+
+	if (gameboy->dma.mode == DMA_ACCURATE){
+		startAccurateTransfer(gameboy, source);
+		return;
+	}
+
+	copyBlock(gameboy, source);
+}
+
+void updateDMA(struct gameboy * gameboy)
+{
+	if (!gameboy->dma.active){
+		return;
+	}
+
+	//copy one byte per elapsed M-cycle
+	gameboy->dma.cycleCounter += gameboy->cpu.previousInstruction.cycles;
+	const uint8_t * block = getMemoryBlock(gameboy, gameboy->dma.source);
+	while (gameboy->dma.cycleCounter >= CYCLES_PER_DMA_BYTE){
+		gameboy->dma.cycleCounter -= CYCLES_PER_DMA_BYTE;
+		uint8_t i = gameboy->dma.bytesTransferred;
+		beforeSpriteTableWrite(gameboy);
+		gameboy->memory.spriteTable[i] = (block != NULL) ? block[i] : 0xFF;
+		if (++gameboy->dma.bytesTransferred == DMA_TRANSFER_LENGTH){
+			finishTransfer(gameboy);
+			break;
+		}
+	}
+}
+
+bool isDMABlockingBus(struct gameboy * gameboy, uint16_t address)
+{
+	//while a transfer is running, the CPU can only get at I/O and high RAM
+	return gameboy->dma.active && (address < IO_START);
+}
+
+static void startAccurateTransfer(struct gameboy * gameboy, uint16_t source)
+{
+	//writing 0xFF46 mid transfer restarts it from the new source
+	gameboy->dma.active = true;
+	gameboy->dma.source = source;
+	gameboy->dma.bytesTransferred = 0;
+	gameboy->dma.cycleCounter = 0;
+}
+
+static void finishTransfer(struct gameboy * gameboy)
+{
+	gameboy->dma.active = false;
+	gameboy->dma.bytesTransferred = 0;
+	gameboy->dma.cycleCounter = 0;
+}
+
+static void copyBlock(struct gameboy * gameboy, uint16_t source)
+{
+	//the source block never crosses a page boundary (0xXX00 - 0xXX9F), so it
+	//can be resolved once through the memory map and copied in one go
+	beforeSpriteTableWrite(gameboy);
+	const uint8_t * block = getMemoryBlock(gameboy, source);
+	if (block == NULL){
+		memset(gameboy->memory.spriteTable, 0xFF, DMA_TRANSFER_LENGTH);
+		return;
+	}
+	memcpy(gameboy->memory.spriteTable, block, DMA_TRANSFER_LENGTH);
+}
+
+void startHDMA(struct gameboy * gameboy, uint8_t data)
+{
+	struct dma * dma = &gameboy->dma;
+	bool hblank = isBitSet(data, HDMA_HBLANK_BIT);
+	if (dma->hdmaActive && !hblank){
+		//cancels the HBlank transfer, leaving the blocks left readable
+		dma->hdmaActive = false;
+		return;
+	}
+
+	//the source and destination are 16 byte aligned, and the destination is
+	//always in VRAM
+	const uint8_t * io = gameboy->memory.io;
+	dma->hdmaSource = ((io[HDMA_SOURCE_HIGH_REG - IO_START] << 8) | io[HDMA_SOURCE_LOW_REG - IO_START]) & 0xFFF0;
+	dma->hdmaDestination = VRAM_START | (((io[HDMA_DESTINATION_HIGH_REG - IO_START] << 8) | io[HDMA_DESTINATION_LOW_REG - IO_START]) & 0x1FF0);
+	dma->hdmaBlocksLeft = (data & 0x7F) + 1;
+
+	if (hblank){
+		dma->hdmaActive = true;
+		return;
+	}
+	gameboy->cpu.cycles += dma->hdmaBlocksLeft * HDMA_BLOCK_CYCLES;
+	while (dma->hdmaBlocksLeft > 0){
+		copyHDMABlock(gameboy);
+	}
+}
+
+void doHBlankDMA(struct gameboy * gameboy)
+{
+	//called as each visible line enters HBlank
+	struct dma * dma = &gameboy->dma;
+	if (!dma->hdmaActive){
+		return;
+	}
+	gameboy->cpu.cycles += HDMA_BLOCK_CYCLES;
+	copyHDMABlock(gameboy);
+	if (dma->hdmaBlocksLeft == 0){
+		dma->hdmaActive = false;
 	}
 }
+
+uint8_t getHDMAStatus(struct gameboy * gameboy)
+{
+	//blocks left - 1, with bit 7 set once it's no longer running. A finished
+	//transfer reads 0xFF
+	struct dma * dma = &gameboy->dma;
+	uint8_t blocksLeft = (dma->hdmaBlocksLeft - 1) & 0x7F;
+	return dma->hdmaActive ? blocksLeft : (0x80 | blocksLeft);
+}
+
+static void copyHDMABlock(struct gameboy * gameboy)
+{
+	struct dma * dma = &gameboy->dma;
+	uint8_t block[HDMA_BLOCK_SIZE];
+	const uint8_t * source = getMemoryBlock(gameboy, dma->hdmaSource);
+	bool fromVideoRam = (dma->hdmaSource >= VRAM_START) && (dma->hdmaSource < RAM_BANK_START);
+	if ((source == NULL) || fromVideoRam){
+		//there's nothing for HDMA to read there
+		memset(block, 0xFF, HDMA_BLOCK_SIZE);
+	}
+	else {
+		memcpy(block, source, HDMA_BLOCK_SIZE);
+	}
+	writeVideoRamBlock(gameboy, dma->hdmaDestination, block, HDMA_BLOCK_SIZE);
+
+	//the destination wraps within VRAM
+	dma->hdmaSource += HDMA_BLOCK_SIZE;
+	dma->hdmaDestination = VRAM_START | ((dma->hdmaDestination + HDMA_BLOCK_SIZE) & (VRAM_SIZE - 1));
+	dma->hdmaBlocksLeft--;
+}
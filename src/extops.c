@@ -498,7 +498,7 @@ void executeExtendedOpcode(struct gameboy * gameboy, uint8_t opcode)
 	
 	((void(*)(struct gameboy *))instruction.function)(gameboy); //do instruction
 
-	gameboy->cpu.cycles += cycles;
+	gameboy->cpu.cycles += gameboy->cpu.doubleSpeed ? cycles / 2 : cycles;
 
 //	printf("extended op: %s\n", instruction.instruction);
 }
@@ -2,13 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
-#include <unistd.h>
-#include <time.h>
 #include "../include/gameboy.h"
 #include "../include/registers.h"
 #include "../include/joypad.h"
-#include "../include/display.h"
 #include "../include/bitUtils.h"
+#include "../include/dma.h"
 
 static void initialiseCPU(struct gameboy * gameboy);
 static void initialiseMemory(struct gameboy * gameboy);
@@ -18,60 +16,48 @@ struct gameboy * createGameboy()
 {
 	printf("Creating GameBoy structure... ");
 	struct gameboy * gameboy;
-	gameboy = malloc(sizeof(struct gameboy));
+	gameboy = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct gameboy));
 	
 	if (gameboy == NULL){
 		//handle this in calling function
 		return NULL;
 	}
-	printf("done.\n");
+	memset(gameboy, 0, sizeof(struct gameboy));
 
-	reset(gameboy);
-	return gameboy;
-	
-}
+	if (!allocateMemory(gameboy)){
+		free(gameboy);
+		return NULL;
+	}
 
-void startEmulationLoop(struct gameboy * gameboy)
-{
-	SDL_Event event;
-	Uint8 * keys = NULL;
-	bool quit = false;
+	gameboy->screen.palettes.shades = greyscaleShades;
 
-	while(!quit){
-		doJoypad(gameboy, &event, &keys, &quit);
-		update(gameboy); //call this 60 times a second
+	//hosts with no use for the core's conversion (the display, headless) switch to PIXEL_FORMAT_INDEXED
+	if (!setPixelFormat(gameboy, PIXEL_FORMAT_RGB888)){
+		destroyGameboy(gameboy);
+		return NULL;
 	}
+	printf("done.\n");
 
-	SDL_Quit();
-
+	reset(gameboy);
+	return gameboy;
+	
 }
 
-void update(struct gameboy * gameboy)
+void runFrame(struct gameboy * gameboy)
 {
-	static int frame;
-	int cycles = 0;
-	clock_t start = clock();
-	while (cycles <= CYCLES_PER_FRAME){
+	//one frame's worth of emulation, as fast as the host can go. The cycle
+	//count is wound back afterwards, so it never grows past a frame
+	while (gameboy->cpu.cycles <= CYCLES_PER_FRAME){
 		executeNextOpcode(gameboy);
 		updateTimers(gameboy);
-		updateGraphicsTest(gameboy);
+		updateDMA(gameboy);
+		if (gameboy->cpu.cycles >= gameboy->screen.nextEventCycle){
+			updateGraphics(gameboy);
+		}
 		serviceInterrupts(gameboy);
-		cycles = gameboy->cpu.cycles;
-		
 	}
-	renderGraphics(gameboy);
-	float elapsedSecs = (float)(clock() - start)/CLOCKS_PER_SEC;
-	float remainingFrameTime = (1/(float)FPS) - elapsedSecs;
-	const struct timespec req = {0, remainingFrameTime * 1000000000L};
-	nanosleep(&req, NULL);
 	gameboy->cpu.cycles -= CYCLES_PER_FRAME;
-	++frame;
-	//printf("frame: %d\n", frame);
-	if (frame % 60 == 0){
-		printf("frame %d, %f\n", frame, (remainingFrameTime + elapsedSecs));
-		printf("elapsed secs: %f\n", elapsedSecs);
-	}
-	
+	rebaseLCDCycles(gameboy, CYCLES_PER_FRAME);
 }
 
 void reset(struct gameboy * gameboy)
@@ -79,12 +65,15 @@ void reset(struct gameboy * gameboy)
 	initialiseCPU(gameboy);
 	initialiseMemory(gameboy);
 	initialiseControls(gameboy);
+	initialiseDMA(gameboy);
 }
 
 static void initialiseCPU(struct gameboy * gameboy)
 {
 	printf("Resetting CPU... ");
-	gameboy->cpu.af = INIT_AF;
+	gameboy->cpu.af = gameboy->cartridge.cgb ? INIT_AF_CGB : INIT_AF;
+	gameboy->cpu.doubleSpeed = false;
+	gameboy->cpu.speedSwitchArmed = false;
 	gameboy->cpu.bc = INIT_BC;
 	gameboy->cpu.de = INIT_DE;
 	gameboy->cpu.hl = INIT_HL;
@@ -100,45 +89,46 @@ static void initialiseMemory(struct gameboy * gameboy)
 	//directly alter memory if needs be (eg certain timers that reset if written 
 	//to 'properly' through writeMemory)
 	printf("Resetting memory... ");
-	memset(gameboy->memory.mem, 0, sizeof(gameboy->memory.mem));
-	memset(gameboy->cartridge.memory, 0, sizeof(gameboy->cartridge.memory));
-	//memset(gameboy->screen.frameBuffer3D, 0, sizeof(gameboy->screen.frameBuffer3D));
+	clearMemory(gameboy);
 	
 	//gameboy->interrupts.masterEnable = true;
 	//setBit(&gameboy->screen.control, bgDisplayEnable, true);
 	//setBit(&gameboy->screen.control, spriteEnable, true);
 
-	gameboy->memory.mem[0xFF05] = 0x0; //TIMA
-	gameboy->memory.mem[0xFF06] = 0x0;
-	gameboy->memory.mem[0xFF07] = 0x0;
-	gameboy->memory.mem[0xFF10] = 0x80;
-	gameboy->memory.mem[0xFF11] = 0x80;
-	gameboy->memory.mem[0xFF12] = 0xF3;
-	gameboy->memory.mem[0xFF14] = 0xBF;
-	gameboy->memory.mem[0xFF16] = 0x3F;
-	gameboy->memory.mem[0xFF17] = 0x0;
-	gameboy->memory.mem[0xFF19] = 0xBF;
-	gameboy->memory.mem[0xFF1A] = 0x7F;
-	gameboy->memory.mem[0xFF1B] = 0xFF;
-	gameboy->memory.mem[0xFF1C] = 0x9F;
-	gameboy->memory.mem[0xFF1E] = 0xBF;
-	gameboy->memory.mem[0xFF20] = 0xFF;
-	gameboy->memory.mem[0xFF21] = 0x00;
-	gameboy->memory.mem[0xFF22] = 0x00;
-	gameboy->memory.mem[0xFF23] = 0xBF;
-	gameboy->memory.mem[0xFF24] = 0x77;
-	gameboy->memory.mem[0xFF25] = 0xF3;
-	gameboy->memory.mem[0xFF26] = 0xF1;
-	gameboy->memory.mem[0xFF40] = 0x91;
-	gameboy->memory.mem[0xFF42] = 0x0;
-	gameboy->memory.mem[0xFF43] = 0x0;
-	gameboy->memory.mem[0xFF45] = 0x0;
-	gameboy->memory.mem[0xFF47] = 0xFC;
-	gameboy->memory.mem[0xFF48] = 0xFF;
-	gameboy->memory.mem[0xFF49] = 0xFF;
-	gameboy->memory.mem[0xFF4A] = 0x0;
-	gameboy->memory.mem[0xFF4B] = 0x0;
-	gameboy->memory.mem[0xFFFF] = 0x0;
+	gameboy->memory.io[0x05] = 0x0; //TIMA
+	gameboy->memory.io[0x06] = 0x0;
+	gameboy->memory.io[0x07] = 0x0;
+	gameboy->memory.io[0x10] = 0x80;
+	gameboy->memory.io[0x11] = 0x80;
+	gameboy->memory.io[0x12] = 0xF3;
+	gameboy->memory.io[0x14] = 0xBF;
+	gameboy->memory.io[0x16] = 0x3F;
+	gameboy->memory.io[0x17] = 0x0;
+	gameboy->memory.io[0x19] = 0xBF;
+	gameboy->memory.io[0x1A] = 0x7F;
+	gameboy->memory.io[0x1B] = 0xFF;
+	gameboy->memory.io[0x1C] = 0x9F;
+	gameboy->memory.io[0x1E] = 0xBF;
+	gameboy->memory.io[0x20] = 0xFF;
+	gameboy->memory.io[0x21] = 0x00;
+	gameboy->memory.io[0x22] = 0x00;
+	gameboy->memory.io[0x23] = 0xBF;
+	gameboy->memory.io[0x24] = 0x77;
+	gameboy->memory.io[0x25] = 0xF3;
+	gameboy->memory.io[0x26] = 0xF1;
+	gameboy->memory.io[0x42] = 0x0;
+	gameboy->memory.io[0x43] = 0x0;
+	gameboy->memory.io[0x45] = 0x0;
+	gameboy->memory.io[0x47] = 0xFC;
+	gameboy->memory.io[0x48] = 0xFF;
+	gameboy->memory.io[0x49] = 0xFF;
+	gameboy->memory.io[0x4A] = 0x0;
+	gameboy->memory.io[0x4B] = 0x0;
+	gameboy->memory.io[0xFF] = 0x0;
+
+	//rebuild the palette lookup tables from the registers above
+	setShades(gameboy, gameboy->screen.palettes.shades);
+	resetLCD(gameboy);
 
 	printf("done\n");
 
@@ -146,13 +136,48 @@ static void initialiseMemory(struct gameboy * gameboy)
 
 static void initialiseControls(struct gameboy * gameboy)
 {
-	gameboy->joypad.state = malloc(sizeof(int) * NO_OF_BUTTONS); //calloc with 1?
-	gameboy->joypad.previousState = malloc(sizeof(int) * NO_OF_BUTTONS); //calloc with 1?
-	gameboy->memory.mem[JOYPAD_REG] = JOYPAD_REG_INIT; //00001111
+	gameboy->memory.io[JOYPAD_REG - IO_START] = JOYPAD_REG_INIT; //00001111
 	gameboy->joypad.buttonState = 0xFF; //all bits set to 1
 }
 
+int forkGameboy(struct gameboy * parent, struct gameboy ** children, int noOfChildren)
+{
+	//children share every RAM page with the parent (and each other) until
+	//something writes to it, so a fork costs a struct copy and a framebuffer copy
+	for (int i = 0; i < noOfChildren; i++){
+		struct gameboy * child = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct gameboy));
+		if (child == NULL){
+			return i;
+		}
+		memcpy(child, parent, sizeof(struct gameboy));
+
+		if (!copyScreenBuffers(parent, child)){
+			free(child);
+			return i;
+		}
+
+		if (!shareCheats(parent, child)){
+			freeScreenBuffers(child);
+			free(child);
+			return i;
+		}
+
+		if (!shareMemory(parent, child)){
+			clearCheats(child);
+			freeScreenBuffers(child);
+			free(child);
+			return i;
+		}
+		children[i] = child;
+	}
+
+	return noOfChildren;
+}
+
 void destroyGameboy(struct gameboy * gameboy)
 {
+	unloadGame(gameboy);
+	freeMemory(gameboy);
+	freeScreenBuffers(gameboy);
 	free(gameboy);
 }
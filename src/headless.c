@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "../include/gameboy.h"
+#include "../include/cartridge.h"
+#include "../include/joypad.h"
+#include "../include/inputScript.h"
+
+/*
+Headless frontend - runs a ROM with no window, SDL or GL, as fast as the CPU
+allows, for servers with no display. It's built against the core alone (see
+the headless target in the Makefile).
+
+	headless [-f frames] [-i inputScript] [-s] rom
+
+The display is a null one: frames are drawn into the index buffer only
+(PIXEL_FORMAT_INDEXED), and never presented. -s skips drawing them too, so
+nothing runs but the CPU and memory. Input comes from a script (see
+inputScript.h) rather than a keyboard.
+
+At the end it prints how fast it ran, and a hash of the last frame drawn so
+runs can be compared.
+*/
+
+#define DEFAULT_HEADLESS_FRAMES 3600 //a minute of emulated time
+
+static uint32_t hashFrame(const struct screen * screen);
+static double now();
+
+int main(int argc, char ** argv)
+{
+	int frames = DEFAULT_HEADLESS_FRAMES;
+	const char * scriptPath = NULL;
+	bool skipDrawing = false;
+	int option;
+	while ((option = getopt(argc, argv, "f:i:s")) != -1){
+		switch (option){
+			case 'f':
+				frames = atoi(optarg);
+				break;
+			case 'i':
+				scriptPath = optarg;
+				break;
+			case 's':
+				skipDrawing = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-f frames] [-i inputScript] [-s] rom\n", argv[0]);
+				return -1;
+		}
+	}
+	if (optind != argc - 1){
+		fprintf(stderr, "Usage: %s [-f frames] [-i inputScript] [-s] rom\n", argv[0]);
+		return -1;
+	}
+
+	struct inputScript * script = NULL;
+	if (scriptPath != NULL){
+		script = loadInputScript(scriptPath);
+		if (script == NULL){
+			return -1;
+		}
+	}
+
+	struct gameboy * gameboy = createGameboy();
+	if ((gameboy == NULL) || !setPixelFormat(gameboy, PIXEL_FORMAT_INDEXED)){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		return -1;
+	}
+	loadGame(gameboy, argv[optind]);
+	if (skipDrawing){
+		//not even the first frame is drawn, so the render caches are never allocated
+		setFrameSkip(gameboy, FRAME_SKIP_ALL, 0);
+	}
+
+	uint8_t held = 0;
+	double start = now();
+	for (int frame = 0; frame < frames; frame++){
+		if (script != NULL){
+			uint8_t scripted = getScriptedButtons(script, frame);
+			if (scripted != held){
+				setHeldButtons(gameboy, scripted);
+				held = scripted;
+			}
+		}
+		runFrame(gameboy);
+		takeFrame(gameboy); //the null display has nothing to present
+	}
+	double elapsed = now() - start;
+
+	printf("%d frames in %.3fs: %.0f fps, %.1fx real time\n", frames, elapsed, frames / elapsed, frames / (elapsed * FPS));
+	if (!skipDrawing){
+		printf("last frame hash: %08x\n", hashFrame(&gameboy->screen));
+	}
+
+	destroyGameboy(gameboy);
+	freeInputScript(script);
+	return 0;
+}
+
+static uint32_t hashFrame(const struct screen * screen)
+{
+	//FNV-1a over the shades (or CGB colour indices)
+	uint8_t mask = screen->colourFrames ? CGB_PIXEL_MASK : PIXEL_SHADE_MASK;
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < X * Y; i++){
+		hash = (hash ^ (screen->indexBuffer[i] & mask)) * 16777619u;
+	}
+	return hash;
+}
+
+static double now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + (time.tv_nsec / 1e9);
+}
@@ -0,0 +1,113 @@
+#include "../include/inputScript.h"
+#include "../include/joypad.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SCRIPT_LINE 256
+
+static bool parseButtons(char * text, uint8_t * held);
+static bool addEvent(struct inputScript * script, int frame, uint8_t held);
+
+static const char * buttonNames[NO_OF_BUTTONS] = {
+	[SELECT] = "SELECT",
+	[START] = "START",
+	[B] = "B",
+	[A] = "A",
+	[RIGHT] = "RIGHT",
+	[LEFT] = "LEFT",
+	[DOWN] = "DOWN",
+	[UP] = "UP"
+};
+
+struct inputScript * loadInputScript(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	if (file == NULL){
+		fprintf(stderr, "Couldn't open input script %s\n", path);
+		return NULL;
+	}
+	struct inputScript * script = calloc(1, sizeof(struct inputScript));
+	if (script == NULL){
+		fclose(file);
+		return NULL;
+	}
+
+	char line[MAX_SCRIPT_LINE];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file) != NULL){
+		lineNumber++;
+		char buttons[MAX_SCRIPT_LINE];
+		int frame;
+		if ((line[0] == '#') || (sscanf(line, " %s", buttons) != 1)){
+			continue; //comment or blank
+		}
+
+		uint8_t held;
+		bool valid = (sscanf(line, "%d %s", &frame, buttons) == 2) && parseButtons(buttons, &held);
+		if (valid && (script->count > 0) && (frame < script->events[script->count - 1].frame)){
+			valid = false;
+		}
+		if (!valid){
+			fprintf(stderr, "%s:%d: expected \"<frame> <buttons>\" in frame order\n", path, lineNumber);
+			freeInputScript(script);
+			fclose(file);
+			return NULL;
+		}
+		if (!addEvent(script, frame, held)){
+			freeInputScript(script);
+			fclose(file);
+			return NULL;
+		}
+	}
+	fclose(file);
+	return script;
+}
+
+uint8_t getScriptedButtons(struct inputScript * script, int frame)
+{
+	while ((script->next < script->count) && (script->events[script->next].frame <= frame)){
+		script->held = script->events[script->next].held;
+		script->next++;
+	}
+	return script->held;
+}
+
+void freeInputScript(struct inputScript * script)
+{
+	if (script != NULL){
+		free(script->events);
+		free(script);
+	}
+}
+
+static bool parseButtons(char * text, uint8_t * held)
+{
+	*held = 0;
+	if (strcmp(text, "-") == 0){
+		return true;
+	}
+	for (char * name = strtok(text, "+"); name != NULL; name = strtok(NULL, "+")){
+		int button = 0;
+		while ((button < NO_OF_BUTTONS) && (strcmp(name, buttonNames[button]) != 0)){
+			button++;
+		}
+		if (button == NO_OF_BUTTONS){
+			return false;
+		}
+		*held |= 1 << button;
+	}
+	return true;
+}
+
+static bool addEvent(struct inputScript * script, int frame, uint8_t held)
+{
+	struct inputEvent * events = realloc(script->events, (script->count + 1) * sizeof(struct inputEvent));
+	if (events == NULL){
+		return false;
+	}
+	events[script->count] = (struct inputEvent){frame, held};
+	script->events = events;
+	script->count++;
+	return true;
+}
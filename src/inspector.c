@@ -0,0 +1,168 @@
+#include "../include/inspector.h"
+#include "../include/gameboy.h"
+#include "../include/renderer.h"
+#include "../include/tileDecode.h"
+#include "../include/bitUtils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void drawTile(const struct inspectorSnapshot * snapshot, int bank, int tile, uint8_t attribute, uint8_t * out, int pitch);
+
+bool requestInspection(struct gameboy * gameboy)
+{
+	//the snapshot handed out last is the host's until now
+	struct inspector * inspector = gameboy->screen.inspector;
+	if (inspector == NULL){
+		inspector = calloc(1, sizeof(struct inspector));
+		if (inspector == NULL){
+			return false;
+		}
+		gameboy->screen.inspector = inspector;
+	}
+	atomic_store(&inspector->ready, false);
+	atomic_store_explicit(&inspector->requested, true, memory_order_release);
+	return true;
+}
+
+const struct inspectorSnapshot * getInspection(struct gameboy * gameboy)
+{
+	//NULL until the vblank after the request
+	struct inspector * inspector = gameboy->screen.inspector;
+	if ((inspector == NULL) || !atomic_load_explicit(&inspector->ready, memory_order_acquire)){
+		return NULL;
+	}
+	return &inspector->snapshot;
+}
+
+void takeInspectorSnapshot(struct gameboy * gameboy)
+{
+	//called at vblank, and only copies anything when a snapshot was asked for
+	struct inspector * inspector = gameboy->screen.inspector;
+	if ((inspector == NULL) || !atomic_load_explicit(&inspector->requested, memory_order_acquire)){
+		return;
+	}
+
+	struct inspectorSnapshot * snapshot = &inspector->snapshot;
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		int bank = i / NO_OF_VRAM_PAGES;
+		int page = i % NO_OF_VRAM_PAGES;
+		struct page * source = gameboy->memory.videoRam[i];
+		if (source != NULL){
+			memcpy(&snapshot->videoRam[bank][page * PAGE_SIZE], source->data, PAGE_SIZE);
+		}
+		else {
+			//a DMG has no bank 1
+			memset(&snapshot->videoRam[bank][page * PAGE_SIZE], 0, PAGE_SIZE);
+		}
+	}
+	memcpy(snapshot->spriteTable, gameboy->memory.spriteTable, SPRITE_RAM_SIZE);
+	memcpy(snapshot->pixel, gameboy->screen.palettes.pixel, sizeof(snapshot->pixel));
+	memcpy(snapshot->colours, gameboy->screen.palettes.colours, sizeof(snapshot->colours));
+	memcpy(snapshot->shades, gameboy->screen.palettes.shades, sizeof(snapshot->shades));
+	snapshot->control = gameboy->screen.control;
+	snapshot->cgb = gameboy->cartridge.cgb;
+
+	atomic_store(&inspector->requested, false);
+	atomic_store_explicit(&inspector->ready, true, memory_order_release);
+}
+
+void drawTileSheet(const struct inspectorSnapshot * snapshot, int bank, uint8_t * out)
+{
+	//TILE_SHEET_WIDTH x TILE_SHEET_HEIGHT, tile 0 at the top left
+	for (int tile = 0; tile < NO_OF_TILES; tile++){
+		int x = (tile % TILES_PER_SHEET_ROW) * TILE_SIZE;
+		int y = (tile / TILES_PER_SHEET_ROW) * TILE_SIZE;
+		drawTile(snapshot, bank, tile, 0, &out[(y * TILE_SHEET_WIDTH) + x], TILE_SHEET_WIDTH);
+	}
+}
+
+void drawTileMap(const struct inspectorSnapshot * snapshot, uint16_t tileMap, uint8_t * out)
+{
+	//the whole 256x256 map at 0x9800 or 0x9C00, including what's scrolled off screen
+	bool unsig = isBitSet(snapshot->control, bgWindowTileDataSelect);
+	for (int row = 0; row < TILE_MAP_TILES; row++){
+		for (int column = 0; column < TILE_MAP_TILES; column++){
+			int offset = tileMap - VRAM_START + (row * TILE_MAP_TILES) + column;
+			uint8_t tileNum = snapshot->videoRam[0][offset];
+			uint8_t attribute = snapshot->cgb ? snapshot->videoRam[1][offset] : 0;
+			int tile = unsig ? tileNum : 256 + (int8_t)tileNum;
+			int bank = isBitSet(attribute, CGB_TILE_BANK_BIT) ? 1 : 0;
+			uint8_t * corner = &out[(row * TILE_SIZE * TILE_MAP_WIDTH) + (column * TILE_SIZE)];
+			drawTile(snapshot, bank, tile, attribute, corner, TILE_MAP_WIDTH);
+		}
+	}
+}
+
+void readSpriteTable(const struct inspectorSnapshot * snapshot, struct spriteEntry * entries)
+{
+	int height = isBitSet(snapshot->control, spriteSize) ? 16 : 8;
+	for (int sprite = 0; sprite < NO_OF_SPRITES; sprite++){
+		const uint8_t * data = &snapshot->spriteTable[sprite * BYTES_PER_SPRITE];
+		struct spriteEntry * entry = &entries[sprite];
+		entry->y = data[0] - 16;
+		entry->x = data[1] - 8;
+		entry->tile = data[2];
+		entry->attributes = data[3];
+		entry->visible = (entry->x > -TILE_SIZE) && (entry->x < X) && (entry->y > -height) && (entry->y < Y);
+		entry->behindBackground = isBitSet(data[3], CGB_PRIORITY_BIT);
+		entry->xFlip = isBitSet(data[3], CGB_X_FLIP_BIT);
+		entry->yFlip = isBitSet(data[3], CGB_Y_FLIP_BIT);
+		if (snapshot->cgb){
+			entry->palette = data[3] & CGB_PALETTE_MASK;
+			entry->bank = isBitSet(data[3], CGB_TILE_BANK_BIT) ? 1 : 0;
+		}
+		else {
+			entry->palette = isBitSet(data[3], 4) ? 1 : 0;
+			entry->bank = 0;
+		}
+	}
+}
+
+bool saveInspectorImage(const struct inspectorSnapshot * snapshot, const char * path, const uint8_t * pixels, int width, int height)
+{
+	//binary PPM - no library needed, and most image viewers open it
+	FILE * file = fopen(path, "wb");
+	if (file == NULL){
+		fprintf(stderr, "Couldn't open %s for writing\n", path);
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int i = 0; i < width * height; i++){
+		uint8_t rgb[3];
+		if (snapshot->cgb){
+			uint16_t colour = snapshot->colours[pixels[i] & CGB_PIXEL_MASK];
+			for (int channel = 0; channel < 3; channel++){
+				uint8_t value = (colour >> (channel * 5)) & 0x1F;
+				rgb[channel] = (value << 3) | (value >> 2);
+			}
+		}
+		else {
+			struct colour shade = snapshot->shades[pixels[i] & PIXEL_SHADE_MASK];
+			rgb[0] = shade.red;
+			rgb[1] = shade.green;
+			rgb[2] = shade.blue;
+		}
+		fwrite(rgb, 1, sizeof(rgb), file);
+	}
+	bool written = !ferror(file);
+	fclose(file);
+	return written;
+}
+
+static void drawTile(const struct inspectorSnapshot * snapshot, int bank, int tile, uint8_t attribute, uint8_t * out, int pitch)
+{
+	//pixels are encoded like indexBuffer: a shade through BGP on a DMG, a
+	//colour index with the attribute's palette on a CGB
+	uint8_t palette = (attribute & CGB_PALETTE_MASK) << PIXEL_PALETTE_SHIFT;
+	for (int row = 0; row < TILE_SIZE; row++){
+		int sourceRow = isBitSet(attribute, CGB_Y_FLIP_BIT) ? TILE_SIZE - 1 - row : row;
+		const uint8_t * data = &snapshot->videoRam[bank][(tile * BYTES_PER_TILE) + (sourceRow * 2)];
+		uint8_t colourIds[TILE_SIZE];
+		decodeTileRow(data[0], data[1], colourIds);
+		for (int pixel = 0; pixel < TILE_SIZE; pixel++){
+			uint8_t colourId = colourIds[isBitSet(attribute, CGB_X_FLIP_BIT) ? TILE_SIZE - 1 - pixel : pixel];
+			out[(row * pitch) + pixel] = snapshot->cgb ? (colourId | palette) : snapshot->pixel[BG_PALETTE][colourId];
+		}
+	}
+}
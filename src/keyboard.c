@@ -0,0 +1,28 @@
+#include "../include/keyboard.h"
+#include "../include/joypad.h"
+
+struct buttonMap buttons[NO_OF_BUTTONS] = {
+	{UP, SDLK_w}, 
+	{DOWN, SDLK_s},
+	{LEFT, SDLK_a},
+	{RIGHT, SDLK_d},
+	{A, SDLK_i},
+	{B, SDLK_j},
+	{START, SDLK_RETURN},
+	{SELECT, SDLK_SPACE}
+	
+};
+
+uint8_t getHeldButtons(Uint8 * keys)
+{
+	//bit n set - button n is held. Only reads SDL's key state, so it can run
+	//on whichever thread polls the events
+	uint8_t held = 0;
+	for (int i = 0; i < NO_OF_BUTTONS; i++){
+		struct buttonMap currentButton = buttons[i]; //{button, mapped sdl button}
+		if (keys[currentButton.sdlKey]){
+			held |= 1 << currentButton.button;
+		}
+	}
+	return held;
+}
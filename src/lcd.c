@@ -1,155 +1,152 @@
 #include "../include/lcd.h"
-#include "../include/display.h"
 #include "../include/bitUtils.h"
 #include "../include/gameboy.h"
 #include "../include/memory.h"
+#include "../include/tileDecode.h"
+#include "../include/renderer.h"
+#include "../include/renderThread.h"
+#include "../include/pixelFifo.h"
+#include "../include/dma.h"
+#include "../include/inspector.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
-static void doScanline(struct gameboy * gameboy);
-static void handleCurrentScanline(struct gameboy * gameboy);
-static void startNewScanline(struct gameboy * gameboy);
 static uint8_t getCurrentMode(struct gameboy * gameboy);
-
-//static bool isInHBlankBounds(struct gameboy * gameboy);
-static bool isInVBlankBounds(struct gameboy * gameboy);
-static bool isInSpriteAttributeBounds(struct gameboy * gameboy);
-static bool isInDriverTransferBounds(struct gameboy * gameboy);
-
-static void handleHBlank(struct gameboy * gameboy);
-static void handleVBlank(struct gameboy * gameboy);
-static void handleSpriteSearch(struct gameboy * gameboy);
-static void handleTransferToLCDDriver(struct gameboy * gameboy);
-static void requestAnyNewModeInterrupts(struct gameboy * gameboy, uint8_t previousMode);
+static void startLine(struct gameboy * gameboy, uint8_t line);
+static void startFrame(struct gameboy * gameboy);
+static void setMode(struct gameboy * gameboy, enum statusBitMode mode);
 static void doCoincidenceFlag(struct gameboy * gameboy);
-
-static bool backgroundTilesEnabled(struct gameboy * gameboy);
-static bool spritesEnabled(struct gameboy * gameboy);
-
-static void renderTiles(struct gameboy * gameboy);
-static void renderSprites(struct gameboy * gameboy);
-static bool windowEnabled(struct gameboy * gameboy);
-
-static enum COLOUR getColourEnum(struct gameboy * gameboy, uint8_t colourNum, uint16_t address);
-
-const void (*scanModeFuncs[4]) = {
-	handleHBlank,
-	handleVBlank,
-	handleSpriteSearch,
-	handleTransferToLCDDriver
-};
-
-struct colour white = {255, 255, 255};
-struct colour lightGrey = {0xCC, 0xCC, 0xCC};
-struct colour darkGrey = {0x77, 0x77, 0x77};
-struct colour black = {0, 0, 0};
-
-//move this
-struct colour palette[4] = {
-	{255, 255, 255}, 
-	{0xCC, 0xCC, 0xCC}, 
-	{0x77, 0x77, 0x77}, 
+static int takeWindowLine(struct gameboy * gameboy);
+
+static bool createRenderCaches(struct gameboy * gameboy);
+static void convertFrame(struct gameboy * gameboy);
+static void convertColourPixels(const struct screen * screen, int line, const uint8_t * indices, int count, uint8_t * out);
+static void startVBlank(struct gameboy * gameboy);
+static void chooseNextFrame(struct frameSkip * frameSkip);
+
+const struct colour greyscaleShades[4] = {
+	{255, 255, 255},
+	{0xCC, 0xCC, 0xCC},
+	{0x77, 0x77, 0x77},
 	{0, 0, 0}
 };
 
-struct colour frameBuffer[X * Y];
+const struct colour greenShades[4] = {
+	{0x9B, 0xBC, 0x0F},
+	{0x8B, 0xAC, 0x0F},
+	{0x30, 0x62, 0x30},
+	{0x0F, 0x38, 0x0F}
+};
 
-void updateGraphicsTest(struct gameboy * gameboy)
+void updateGraphics(struct gameboy * gameboy)
 {
-	//fill a frame buffer with some simple pixel data and see if it draws correctly
-	setLCDStatus(gameboy);
-	uint8_t previousMode = getCurrentMode(gameboy);
-	requestAnyNewModeInterrupts(gameboy, previousMode);
-	if (isLCDEnabled(gameboy)){
-		gameboy->screen.scanlineCounter += gameboy->cpu.previousInstruction.cycles;
-	}
-	else {
-		return;
-	}
-	
-	if (gameboy->screen.scanlineCounter >= SCANLINE_CYCLE_TIME){
-		gameboy->screen.currentScanline++;
-		gameboy->screen.scanlineCounter = 0;
-		if (gameboy->screen.currentScanline == Y){
-			requestInterrupt(gameboy, int_vblank);
-			//printf("start vblank\n");
-		}
-		else if (gameboy->screen.currentScanline > (Y + NO_OF_INVISIBLE_SCANLINES)){
-			gameboy->screen.currentScanline = 0;
-			//printf("resetting scanline\n");
-		}
-		else if (gameboy->screen.currentScanline < Y){
-//			printf("drawing scanline %d\n", gameboy->screen.currentScanline);
-			drawScanline(gameboy);
-		}
-		else {
-			//printf("In vblank\n");
+	//only called once the CPU has reached the next transition. Works through
+	//every transition it has passed, each scheduled from the last so the
+	//timing never drifts
+	struct screen * screen = &gameboy->screen;
+	while (gameboy->cpu.cycles >= screen->nextEventCycle){
+		switch (getCurrentMode(gameboy)){
+			case oamRead:
+				setMode(gameboy, oamVramRead);
+				if (screen->renderMode == RENDER_PIXEL_FIFO){
+					startFifoLine(gameboy, screen->nextEventCycle);
+				}
+				else {
+					//the line is drawn with the registers as they are now
+					logScanline(gameboy, takeWindowLine(gameboy));
+				}
+				screen->nextEventCycle += TRANSFER_CYCLES;
+				break;
+			case oamVramRead:
+				if ((screen->renderMode == RENDER_PIXEL_FIFO) && !finishFifoTransfer(gameboy)){
+					//mode 3 runs on until the FIFO has the whole line out
+					screen->nextEventCycle = gameboy->cpu.cycles + getFifoPixelsLeft(gameboy);
+					break;
+				}
+				setMode(gameboy, hBlank);
+				screen->nextEventCycle = screen->lineStartCycle + SCANLINE_CYCLE_TIME;
+				if (gameboy->cartridge.cgb){
+					doHBlankDMA(gameboy);
+				}
+				break;
+			case hBlank:
+				startLine(gameboy, screen->currentScanline + 1);
+				break;
+			case vBlank:
+				startLine(gameboy, (screen->currentScanline + 1) % LINES_PER_FRAME);
+				break;
 		}
 	}
-	
 }
 
-void updateGraphics(struct gameboy * gameboy)
+static void startLine(struct gameboy * gameboy, uint8_t line)
 {
-	int cycles = gameboy->cpu.previousInstruction.cycles;
-	uint8_t previousMode = getCurrentMode(gameboy);
-	setLCDStatus(gameboy);
-	requestAnyNewModeInterrupts(gameboy, previousMode);
-	doCoincidenceFlag(gameboy);
-	if (isLCDEnabled(gameboy)){
-		gameboy->screen.scanlineCounter += cycles;
-		doScanline(gameboy);
+	struct screen * screen = &gameboy->screen;
+	screen->currentScanline = line;
+	screen->lineStartCycle = screen->nextEventCycle;
+	if (line == 0){
+		screen->windowLine = 0;
+		screen->windowYReached = false;
+	}
+	if (line < Y){
+		//WY is only compared at the start of each line
+		if (line == gameboy->memory.io[WINDOW_POS_Y - IO_START]){
+			screen->windowYReached = true;
+		}
+		setMode(gameboy, oamRead);
+		screen->nextEventCycle += OAM_SEARCH_CYCLES;
+	}
+	else {
+		if (line == Y){
+			setMode(gameboy, vBlank);
+			startVBlank(gameboy);
+		}
+		screen->nextEventCycle += SCANLINE_CYCLE_TIME;
 	}
+	doCoincidenceFlag(gameboy);
 }
 
-static void requestAnyNewModeInterrupts(struct gameboy * gameboy, uint8_t previousMode)
+static void startFrame(struct gameboy * gameboy)
 {
-	bool enabled = gameboy->screen.currentLCDInterruptEnabled;
-	uint8_t currentMode = getCurrentMode(gameboy);
-	if (enabled && (currentMode != previousMode)){
-		requestInterrupt(gameboy, lcdStat);
-	}
-	
+	//line 0 starts as soon as the LCD is switched on
+	gameboy->screen.nextEventCycle = gameboy->cpu.cycles;
+	startLine(gameboy, 0);
 }
 
-static void doCoincidenceFlag(struct gameboy * gameboy)
+static void setMode(struct gameboy * gameboy, enum statusBitMode mode)
 {
-	if (gameboy->screen.currentScanline == readByte(gameboy, LY_COMPARE)){
-		//current scanline == the values stored at 0xFF45
-		//if this is true, set bit 2 of the status reg. Otherwise, reset it.
-		setBit(&gameboy->screen.status, COINCIDENCE_BIT, true);
-		if (isBitSet(gameboy->screen.status, COINCIDENCE_ENABLE_BIT)){
-			requestInterrupt(gameboy, lcdStat);
-		}
-	}
-	else {
-		setBit(&gameboy->screen.status, COINCIDENCE_BIT, false);
+	//entering modes 0, 1 and 2 requests an LCD interrupt if its enable bit is set
+	static const int enableBits[] = {HBLANK_ENABLE_BIT, VBLANK_ENABLE_BIT, SPRITE_ENABLE_BIT};
+	uint8_t * status = &gameboy->screen.status;
+	*status = (*status & ~STATUS_MODE_MASK) | mode;
+	if ((mode != oamVramRead) && isBitSet(*status, enableBits[mode])){
+		requestInterrupt(gameboy, lcdStat);
 	}
-			
 }
 
-static void doScanline(struct gameboy * gameboy)
+static int takeWindowLine(struct gameboy * gameboy)
 {
-	if (gameboy->screen.scanlineCounter >= SCANLINE_CYCLE_TIME){
-		//if the number of cycles for this scanline is over 456...
-		//start moving onto the next scan line
-		gameboy->screen.currentScanline++;
-		handleCurrentScanline(gameboy);
+	//the window row for the line about to be drawn. The counter only moves on
+	//when the window is on the line
+	struct screen * screen = &gameboy->screen;
+	uint8_t windowX = gameboy->memory.io[WINDOW_POS_X - IO_START];
+	if (!isBitSet(screen->control, windowDisplayEnable) || !screen->windowYReached || (windowX >= X + 7)){
+		return WINDOW_HIDDEN;
 	}
+	return screen->windowLine++;
 }
 
-static void handleCurrentScanline(struct gameboy * gameboy)
+static void doCoincidenceFlag(struct gameboy * gameboy)
 {
-	uint8_t currentScanline = gameboy->screen.currentScanline;
-	if (currentScanline == Y){
-		requestInterrupt(gameboy, int_vblank);
-	}
-	else if (currentScanline > (Y + NO_OF_INVISIBLE_SCANLINES)){
-		gameboy->screen.currentScanline = 0; //reset
-	}
-	else {
-		drawScanline(gameboy);
+	//current scanline == the value stored at 0xFF45 sets bit 2 of the status
+	//reg, and requests an interrupt if bit 6 is set
+	bool coincidence = (gameboy->screen.currentScanline == gameboy->memory.io[LY_COMPARE - IO_START]);
+	setBit(&gameboy->screen.status, COINCIDENCE_BIT, coincidence);
+	if (coincidence && isBitSet(gameboy->screen.status, COINCIDENCE_ENABLE_BIT)){
+		requestInterrupt(gameboy, lcdStat);
 	}
 }
 
@@ -159,437 +156,672 @@ bool isLCDEnabled(struct gameboy * gameboy)
 	return isBitSet(gameboy->screen.control, lcdEnable);
 }
 
-void setLCDStatus(struct gameboy * gameboy)
+void setLCDControl(struct gameboy * gameboy, uint8_t data)
 {
-	//it take 456 clock cycles to draw 1 scanline
-	//LCD status is in mode 2 for the first 80 (search sprite attrs)
-	//Mode 3 is set for the next 172 (transfer to LCD driver)
-	//The remaining 204 are for mode 0 (hBlank)
-
-	//When the status mode is changed to 0, 1 or 2, an interrupt request occurs
-	//Check bit 3, 4, or 5 to see if mode interrupt 0, 1 or 2 is enabled
-	//when the lcd mode is disabled, the status mode must be set to 1
-	if (!isLCDEnabled(gameboy)){
-		//starting a new scan line sets the lcd status to 2
-		//printf("LCD isn't enabled - starting new scanline\n");
-		startNewScanline(gameboy);
+	bool wasEnabled = isLCDEnabled(gameboy);
+	gameboy->screen.control = data;
+	if (isLCDEnabled(gameboy) && !wasEnabled){
+		startFrame(gameboy);
 	}
-	else {
-	//	printf("LCD is enabled\n");
-		if (isInVBlankBounds(gameboy)){
-			//printf("Handle vblank\n");
-			handleVBlank(gameboy);
-		}
-		else if (isInSpriteAttributeBounds(gameboy)){
-			//printf("Handle OAM\n");
-			handleSpriteSearch(gameboy);
-		}
-		else if (isInDriverTransferBounds(gameboy)){
-			//printf("handle transfer\n");
-			handleTransferToLCDDriver(gameboy);
-		}
-		else {
-			//printf("handle hblank\n");
-			handleHBlank(gameboy);
-		}
-		
+	else if (!isLCDEnabled(gameboy) && wasEnabled){
+		//nothing is scheduled while the LCD is off
+		gameboy->screen.currentScanline = 0;
+		gameboy->screen.status = (gameboy->screen.status & ~STATUS_MODE_MASK) | vBlank;
+		gameboy->screen.nextEventCycle = LCD_OFF_CYCLE;
 	}
+}
 
+void setLCDStatus(struct gameboy * gameboy, uint8_t data)
+{
+	//the mode and coincidence flag are read only
+	uint8_t * status = &gameboy->screen.status;
+	*status = (data & STATUS_WRITABLE_MASK) | (*status & ~STATUS_WRITABLE_MASK);
 }
 
-void drawScanline(struct gameboy * gameboy)
+void resetScanline(struct gameboy * gameboy)
 {
-	//printf("draw scanline\n");
-	if (backgroundTilesEnabled(gameboy)){
-	//	printf("Rendering tiles\n");
-		renderTiles(gameboy);
+	if (isLCDEnabled(gameboy)){
+		startFrame(gameboy);
 	}
-	
-	if (spritesEnabled(gameboy)){
-	//	printf("Rendering Sprites\n");
-		//renderSprites(gameboy);
+	else {
+		gameboy->screen.currentScanline = 0;
 	}
 }
 
-static bool backgroundTilesEnabled(struct gameboy * gameboy)
+void resetLCD(struct gameboy * gameboy)
 {
-	return isBitSet(gameboy->screen.control, bgDisplayEnable);
+	//the boot ROM leaves the LCD on, and the game starts at the top of a frame
+	gameboy->screen.control = 0;
+	gameboy->screen.status = 0;
+	gameboy->screen.nextEventCycle = LCD_OFF_CYCLE;
+	setLCDControl(gameboy, LCD_CONTROL_INIT);
+	resetColourPalettes(gameboy);
 }
 
-static bool spritesEnabled(struct gameboy * gameboy)
+void rebaseLCDCycles(struct gameboy * gameboy, int cycles)
 {
-	return isBitSet(gameboy->screen.control, spriteEnable);
+	//keeps the LCD's timing in step when the CPU's cycle count is wound back
+	if (isLCDEnabled(gameboy)){
+		gameboy->screen.nextEventCycle -= cycles;
+		gameboy->screen.lineStartCycle -= cycles;
+	}
+	if (gameboy->screen.pixelFifo != NULL){
+		gameboy->screen.pixelFifo->startCycle -= cycles;
+	}
 }
 
-static void renderTiles(struct gameboy * gameboy)
+void logScanline(struct gameboy * gameboy, int windowLine)
 {
-	//forgive me father for I have sinned
-	//this and renderSprites copied from codeslinger tut, needs major refactor
-	//I'm just desperate to get something on screen at this point
-
-	uint16_t tileData = 0;
-	uint16_t backgroundMemory = 0;
-	bool unsig = true;
+	//nothing is drawn yet - just note the registers the line will be drawn with
+	if (gameboy->screen.frameSkip.skipping){
+		return;
+	}
+	if (!createRenderCaches(gameboy)){
+		return;
+	}
 
-	//where to draw the visual area and the window
-	uint8_t scrollY = readByte(gameboy, 0xFF42); //the Y origin of the visible 160x144 pixel area in the BG 256x256 map
-	uint8_t scrollX = readByte(gameboy, 0xFF43); //the X coord of the scroll
-	uint8_t windowY= readByte(gameboy, 0xFF4A);
-	uint8_t windowX = readByte(gameboy, 0xFF4B) - 7;
+	struct frameLog * frameLog = gameboy->screen.frameLog;
+	uint8_t scanline = gameboy->screen.currentScanline;
+	if (scanline == 0){
+		frameLog->rendered = 0;
+	}
 
-	bool usingWindow = false;
+	struct scanlineState * state = &frameLog->lines[scanline];
+	state->control = gameboy->screen.control;
+	state->scrollY = gameboy->memory.io[SCROLL_Y - IO_START];
+	state->scrollX = gameboy->memory.io[SCROLL_X - IO_START];
+	state->windowX = gameboy->memory.io[WINDOW_POS_X - IO_START];
+	state->windowLine = windowLine;
+	memcpy(state->pixel, gameboy->screen.palettes.pixel, sizeof(state->pixel));
+	if (gameboy->screen.loggedColours != NULL){
+		memcpy(gameboy->screen.loggedColours[scanline], gameboy->screen.palettes.colours, sizeof(gameboy->screen.loggedColours[0]));
+	}
+	frameLog->logged = scanline + 1;
+}
 
-	if (isBitSet(gameboy->screen.control, 5)){ //is the window enabled?
-		if (windowY <= gameboy->screen.currentScanline){ //is the scanline within the window?
-			//is the current scanline 
-			usingWindow = true;
-		}
+void renderPendingLines(struct gameboy * gameboy)
+{
+	struct frameLog * frameLog = gameboy->screen.frameLog;
+	if ((frameLog == NULL) || (frameLog->rendered >= frameLog->logged)){
+		return;
+	}
+	if (gameboy->screen.renderThread != NULL){
+		submitLines(gameboy, false);
+		return;
 	}
 
-	if (isBitSet(gameboy->screen.control, 4)){ //which tile data?
-		tileData = 0x8000;
+	struct renderer renderer = {
+		.spriteTable = gameboy->memory.spriteTable,
+		.tileCache = gameboy->screen.tileCache,
+		.spriteCache = gameboy->screen.spriteCache,
+		.indexBuffer = gameboy->screen.indexBuffer,
+		.lineColours = gameboy->screen.lineColours,
+		.loggedColours = gameboy->screen.loggedColours,
+		.lineHashes = gameboy->screen.lineHashes,
+		.cgb = gameboy->cartridge.cgb
+	};
+	//VRAM bank 1 is only there on a CGB, and only read by its renderer
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		struct page * page = gameboy->memory.videoRam[i];
+		renderer.videoRam[i] = (page != NULL) ? page->data : NULL;
 	}
-	else {
-		tileData = 0x8800;
-		unsig = false; //tileData at 0x8800 is signed
+	for (int line = frameLog->rendered; line < frameLog->logged; line++){
+		renderLine(&renderer, line, &frameLog->lines[line]);
 	}
+	frameLog->rendered = frameLog->logged;
+}
 
-	if (!usingWindow){
-		if (isBitSet(gameboy->screen.control, 3)){ //which background memory for tiles?
-			backgroundMemory = 0x9C00;
-		}
-		else {
-			backgroundMemory = 0x9800;
+static bool createRenderCaches(struct gameboy * gameboy)
+{
+	struct screen * screen = &gameboy->screen;
+	//allocated on first use, so instances that never draw (or forks that
+	//haven't drawn yet) don't pay for them
+	if (screen->tileCache == NULL){
+		screen->tileCache = createTileCache(screen->colourFrames);
+		if (screen->tileCache == NULL){
+			return false;
 		}
 	}
-	else {
-		if (isBitSet(gameboy->screen.control, 6)){ //which window memory for tiles?
-			backgroundMemory = 0x9C00;
+	if (screen->spriteCache == NULL){
+		screen->spriteCache = createSpriteCache();
+		if (screen->spriteCache == NULL){
+			return false;
 		}
-		else {
-			backgroundMemory = 0x9800;
+	}
+	if (screen->frameLog == NULL){
+		screen->frameLog = calloc(1, sizeof(struct frameLog));
+		if (screen->frameLog == NULL){
+			return false;
 		}
 	}
+	return true;
+}
 
-	uint8_t yPos = 0; //which vertical line the current scanline is drawing
-	
-	if (!usingWindow){
-		yPos = scrollY + gameboy->screen.currentScanline;
+static void convertFrame(struct gameboy * gameboy)
+{
+	//only lines whose hash differs from when they were last converted are
+	//converted. A frame with none is flagged, so the host can leave what's on
+	//screen alone. Indexed hosts read indexBuffer as it is - there's nothing
+	//to convert or compare
+	struct screen * screen = &gameboy->screen;
+	if (screen->frameBuffer == NULL){
+		screen->frameSkip.frameChanged = true;
+		return;
 	}
-	else {
-		yPos = gameboy->screen.currentScanline - windowY;
+
+	bool changed = false;
+	for (int line = 0; line < Y; line++){
+		if (!screen->convertAll && (screen->lineHashes[line] == screen->convertedHashes[line])){
+			continue;
+		}
+		screen->convertedHashes[line] = screen->lineHashes[line];
+		changed = true;
+		convertPixels(screen, line, &screen->indexBuffer[line * X], X, &screen->frameBuffer[line * X * getBytesPerPixel(screen->pixelFormat)]);
 	}
+	screen->convertAll = false;
+	screen->frameSkip.frameChanged = changed;
+}
 
-	//which of the 8 vertical pixels of the current tile is the scanline on?
-	uint16_t vertTilePixel = ((uint8_t)(yPos/8)) * 32;
+void convertPixels(const struct screen * screen, int line, const uint8_t * indices, int count, uint8_t * out)
+{
+	//indices are pixels from the given line of the frame, which picks the
+	//colours on a CGB
+	if (screen->colourFrames && (screen->pixelFormat != PIXEL_FORMAT_INDEXED)){
+		convertColourPixels(screen, line, indices, count, out);
+		return;
+	}
+	switch (screen->pixelFormat){
+		case PIXEL_FORMAT_RGB888:
+			mapScanlineRGB(indices, count, screen->palettes.channelShades, out);
+			break;
+		case PIXEL_FORMAT_RGBA8888:
+		case PIXEL_FORMAT_BGRA8888:
+			//the channel order is already in channelShades
+			mapScanlineRGBA(indices, count, screen->palettes.channelShades, out);
+			break;
+		case PIXEL_FORMAT_RGB565:
+			mapScanline16(indices, count, screen->palettes.packedShades, (uint16_t *)out);
+			break;
+		case PIXEL_FORMAT_INDEXED:
+			memcpy(out, indices, count);
+			break;
+	}
+}
 
-	//draw 160 horizontal pixels for the current scanline
-	for (int pixel = 0; pixel < 160; pixel++){
-		uint8_t xPos = pixel + scrollX;
-		//translate current xPos to window if necessary
-		if (usingWindow){
-			if (pixel >= windowX){
-				xPos = pixel - windowX;
-			}
+static void convertColourPixels(const struct screen * screen, int line, const uint8_t * indices, int count, uint8_t * out)
+{
+	//the line's 64 colours go to the host format once, then each pixel is a
+	//lookup. The 5 bit channels are widened by repeating their top bits, so
+	//white stays 0xFF
+	const uint16_t * colours = screen->lineColours[line];
+	int bytesPerPixel = getBytesPerPixel(screen->pixelFormat);
+	uint8_t table[CGB_COLOURS][4];
+	for (int i = 0; i < CGB_COLOURS; i++){
+		uint8_t red = colours[i] & 0x1F;
+		uint8_t green = (colours[i] >> 5) & 0x1F;
+		uint8_t blue = (colours[i] >> 10) & 0x1F;
+		if (screen->pixelFormat == PIXEL_FORMAT_RGB565){
+			uint16_t packed = (red << 11) | (((green << 1) | (green >> 4)) << 5) | blue;
+			memcpy(table[i], &packed, sizeof(packed));
+			continue;
 		}
+		red = (red << 3) | (red >> 2);
+		green = (green << 3) | (green >> 2);
+		blue = (blue << 3) | (blue >> 2);
+		bool bgra = (screen->pixelFormat == PIXEL_FORMAT_BGRA8888);
+		table[i][0] = bgra ? blue : red;
+		table[i][1] = green;
+		table[i][2] = bgra ? red : blue;
+		table[i][3] = 0xFF;
+	}
+	for (int pixel = 0; pixel < count; pixel++){
+		memcpy(&out[pixel * bytesPerPixel], table[indices[pixel] & CGB_PIXEL_MASK], bytesPerPixel);
+	}
+}
 
-		//which of the 32 horizontal tiles does this xPos fall within?
+void writeColourPalette(struct gameboy * gameboy, uint16_t address, uint8_t data)
+{
+	//BG and OBJ have the same pair of registers, OBJ's 2 bytes later. The
+	//index's unused bit 6 always reads as set
+	int object = (address >= OBJ_COLOUR_INDEX_REG) ? 1 : 0;
+	uint8_t * index = &gameboy->memory.io[BG_COLOUR_INDEX_REG + (object * 2) - IO_START];
+	if ((address == BG_COLOUR_INDEX_REG) || (address == OBJ_COLOUR_INDEX_REG)){
+		*index = data | 0x40;
+		return;
+	}
 
-		uint16_t horTileColumn = xPos/8;
-		int16_t tileNum; //the tile identity number
-		uint16_t tileAddress = backgroundMemory + vertTilePixel + horTileColumn;
+	struct palettes * palettes = &gameboy->screen.palettes;
+	int byte = *index & (CGB_PALETTE_RAM_SIZE - 1);
+	palettes->colourRam[object][byte] = data;
+	const uint8_t * colour = &palettes->colourRam[object][byte & ~1];
+	palettes->colours[(object * (CGB_COLOURS / 2)) + (byte / 2)] = (colour[0] | (colour[1] << 8)) & 0x7FFF;
+	if (isBitSet(*index, COLOUR_INDEX_INCREMENT_BIT)){
+		*index = (*index & 0xC0) | ((byte + 1) & (CGB_PALETTE_RAM_SIZE - 1));
+	}
+}
 
-		if (unsig){
-			tileNum = (uint8_t)readByte(gameboy, tileAddress);
-		}
-		else {
-			tileNum = (int8_t)readByte(gameboy, tileAddress);
-		}
+uint8_t readColourPalette(struct gameboy * gameboy, uint16_t address)
+{
+	int object = (address == OBJ_COLOUR_DATA_REG) ? 1 : 0;
+	uint8_t index = gameboy->memory.io[BG_COLOUR_INDEX_REG + (object * 2) - IO_START];
+	return gameboy->screen.palettes.colourRam[object][index & (CGB_PALETTE_RAM_SIZE - 1)];
+}
 
-		//find the tile in memory
-		uint16_t tileLocation = tileData;
+void resetColourPalettes(struct gameboy * gameboy)
+{
+	//the boot ROM leaves every colour white
+	struct palettes * palettes = &gameboy->screen.palettes;
+	memset(palettes->colourRam, 0xFF, sizeof(palettes->colourRam));
+	for (int i = 0; i < CGB_COLOURS; i++){
+		palettes->colours[i] = 0x7FFF;
+	}
+}
 
-		if (unsig){
-			tileLocation += (tileNum * 16);
+void buildHostShades(struct screen * screen)
+{
+	//shades in screen's pixel format, for a DMG frame to be converted with
+	struct palettes * palettes = &screen->palettes;
+	for (int i = 0; i < 4; i++){
+		struct colour shade = palettes->shades[i];
+		if (screen->pixelFormat == PIXEL_FORMAT_BGRA8888){
+			palettes->channelShades[i] = (struct colour){shade.blue, shade.green, shade.red};
 		}
 		else {
-			tileLocation += ((tileNum + 128) * 6);
+			palettes->channelShades[i] = shade;
 		}
+		palettes->packedShades[i] = ((shade.red >> 3) << 11) | ((shade.green >> 2) << 5) | (shade.blue >> 3);
+	}
+}
 
-		//find the vertical line on the tile the scanline is at
-		uint8_t line = yPos % 8;
-		line *= 2; //each vertical line takes up 2 bytes
-		uint8_t data1 = readByte(gameboy, tileLocation + line);
-		uint8_t data2 = readByte(gameboy, tileLocation + line + 1);
-	
-		//pixel 0 in the tile is bit 7 or data 1 and data 2, pixel 1 is bit 6 etc...
-		int colourBit = xPos % 8;
-		colourBit -= 7;
-		colourBit *= -1;
-
-		int colourNum = getBit(data2, colourBit);
-		colourNum <<= 1;
-		colourNum |= getBit(data1, colourBit);
-
-		//get the actual colour from the palette using the colour ID
-
-		enum COLOUR colour = getColourEnum(gameboy, colourNum, 0xFF47);
-		int red = 0;
-		int green = 0;
-		int blue = 0;
-		
-		switch(colour){
-			case WHITE: red = 255; green = 255; blue = 255; break;
-			case LIGHT_GREY: red = 0xCC; green = 0xCC; blue = 0xCC; break;
-			case DARK_GREY: red = 0x77; green = 0x77; blue = 0x77; break;
-			case BLACK: break;
+static void startVBlank(struct gameboy * gameboy)
+{
+	requestInterrupt(gameboy, int_vblank);
+	applyGameSharkCodes(gameboy);
+	takeInspectorSnapshot(gameboy);
+
+	struct frameSkip * frameSkip = &gameboy->screen.frameSkip;
+	if (gameboy->screen.renderThread != NULL){
+		//the render thread has had this frame's worth of emulation to finish
+		//the last one, which is presented now
+		if (collectFrame(gameboy)){
+			convertFrame(gameboy);
+			frameSkip->frameReady = true;
 		}
-
-		/*gameboy->screen.frameBuffer3D[pixel][gameboy->screen.currentScanline][0] = red;
-		gameboy->screen.frameBuffer3D[pixel][gameboy->screen.currentScanline][1] = green;
-		gameboy->screen.frameBuffer3D[pixel][gameboy->screen.currentScanline][2] = blue;
-		*/
-		/*
-		gameboy->screen.frameBuffer3D[49][99][0] = 255;
-		gameboy->screen.frameBuffer3D[49][99][1] = 255;
-		gameboy->screen.frameBuffer3D[49][99][2] = 255;
-		gameboy->screen.frameBuffer3D[49][100][0] = 255;
-		gameboy->screen.frameBuffer3D[49][100][1] = 255;
-		gameboy->screen.frameBuffer3D[49][100][2] = 255;
-		*/
-		/*
-		int x1 = 50;
-		int y1 = 100;
-		int x2 = 51;
-		int y2 = 100;
-		int width = 160;
-		gameboy->screen.frameBufferNew[3 * (y1 * width + x1) + 0] = 255;
-		gameboy->screen.frameBufferNew[3 * (y1 * width + x1) + 1] = 255;
-		gameboy->screen.frameBufferNew[3 * (y1 * width + x1) + 2] = 255;
-		gameboy->screen.frameBufferNew[3 * (y2 * width + x2) + 0] = 255;
-		gameboy->screen.frameBufferNew[3 * (y2 * width + x2) + 1] = 255;
-		gameboy->screen.frameBufferNew[3 * (y2 * width + x2) + 2] = 255;
-		*/
-
-		gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 0] = red;
-		gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 1] = green;
-		gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 2] = blue;
-	}
-}
-
-
-static enum COLOUR getColourEnum(struct gameboy * gameboy, uint8_t colourNum, uint16_t address)
-{
-	enum COLOUR result = WHITE;
-	uint8_t palette = readByte(gameboy, address);
-	int hi = 0;
-	int lo = 0;
-
-	//which bits of the colour palette does the colour id map to?
-	switch(colourNum)
-	{
-		case 0: hi = 1; lo = 0; break;
-		case 1: hi = 3; lo = 2; break;
-		case 2: hi = 5; lo = 4; break;
-		case 3: hi = 7; lo = 6; break;
-	}
-
-	//use the palette to get the colour
-	int colour = 0;
-	colour = getBit(palette, hi) << 1;
-	colour |= getBit(palette, lo);
-
-	//convert the game colour to emulator colour
-	switch(colour)
-	{
-		case 0: result = WHITE; break;
-		case 1: result = LIGHT_GREY; break;
-		case 2: result = DARK_GREY; break;
-		case 3: result = BLACK; break;
-	}
-
-	return result;
-}	
-
-static void renderSprites(struct gameboy * gameboy)
-{
-	//40 tiles in 0x8000 - 0x8FFF
-	//scan through them all, check their attributes to find where they need to be rendered
-	//sprite attributes found in the sprite attribute table 0xFE00-0xFE9F
-	//each sprite has 4 bytes of attributes: y pos, x pos, sprite id, attributes
-
-	bool use8x16 = false;
-	if (isBitSet(gameboy->screen.control, 2)){
-		use8x16 = true; //using sprite size of 8x16 pixels
-	}
-	
-	for (int sprite = 0; sprite < 40; sprite++){
-		//for each of the 40 sprites
-		uint8_t spriteIndex = sprite * 4; //sprite occupies 4 bytes in the sprite attribute table
-		uint8_t yPos = readByte(gameboy, (uint16_t)(0xFE00 + spriteIndex)) - 16; //index into sprite table, zero Y coord (offset by height)
-		uint8_t xPos = readByte(gameboy, (uint16_t)(0xFE00 + spriteIndex + 1)) - 8; //index into sprite table, zero X coord (offset by width)
-		uint8_t tileNum = readByte(gameboy, (uint16_t)(0xFE00 + index + 2));
-		uint8_t attributes = readByte(gameboy, (uint16_t)(0xFE00 + index + 3));
-
-		/* attributes table:
-			bit 7: sprite to background priority
-			bit 6: Y flip
-			bit 5: x flip
-			bit 4: colour palette number
-			bit 3: not used in standard gameboy
-			bit 2-0: not used in standard gameboy	
-		*/
-
-		//is the sprite flipped?
-		bool yFlip = isBitSet(attributes, 6);
-		bool xFlip = isBitSet(attributes, 5);
-
-		uint8_t scanline = gameboy->screen.currentScanline;
-
-		//store height of sprite
-		int ySize = 8;
-		if (use8x16){
-			ySize = 16;
+		if (!frameSkip->skipping){
+			submitLines(gameboy, true);
 		}
+	}
+	else if (!frameSkip->skipping){
+		renderPendingLines(gameboy);
+		convertFrame(gameboy);
+		frameSkip->frameReady = true;
+	}
+	chooseNextFrame(frameSkip);
+}
 
-		//is the scanline intercepting the sprite?
-		if ((scanline >= yPos) && (scanline < (yPos + ySize))){
-			//the vertical line on the sprite the scanline is at
-			int line = scanline - yPos;
-
-			if (yFlip){
-				line -= ySize;
-				line *= -1;
+static void chooseNextFrame(struct frameSkip * frameSkip)
+{
+	//decided at vblank, so a frame is either drawn or skipped as a whole
+	switch(frameSkip->mode){
+		case FRAME_SKIP_OFF:
+			frameSkip->counter = 0;
+			break;
+		case FRAME_SKIP_FIXED:
+			frameSkip->counter = (frameSkip->counter + 1) % frameSkip->interval;
+			break;
+		case FRAME_SKIP_AUTO:
+			if (frameSkip->hostBehind && (frameSkip->counter < frameSkip->interval)){
+				frameSkip->counter++;
+			}
+			else {
+				frameSkip->counter = 0;
 			}
+			break;
+		case FRAME_SKIP_ALL:
+			frameSkip->counter = 1; //never comes round to a drawn frame
+			break;
+	}
+	frameSkip->skipping = (frameSkip->counter != 0);
+}
 
-			line *= 2; //two bytes, same as tiles
-			uint16_t dataAddress = (0x8000 + (tileNum * 16)) + line;
-			uint8_t data1 = readByte(gameboy, dataAddress);
-			uint8_t data2 = readByte(gameboy, dataAddress+1);
-
-			//read from right to left, as pixel 0 is bit 7 etc.
-			for (int pixel = 7; pixel >= 0; pixel--){
-				int colourBit = pixel;
-				if (xFlip){
-					colourBit -= 7;
-					colourBit *= -1;
-				}
-	
-				//the rest is the same as for tiles
-				int colourNum = getBit(data2, colourBit);
-				colourNum <<= 1;
-				colourNum |= getBit(data1, colourBit);
-				
-				uint16_t colourAddress = isBitSet(attributes, 4) ? 0xFF49 : 0xFF48;
-				enum COLOUR colour = getColourEnum(gameboy, colourNum, colourAddress);
-
-				//white is transparent for sprites
-				if (colour == WHITE){
-					continue;
-				}
+void setFrameSkip(struct gameboy * gameboy, enum frameSkipMode mode, int interval)
+{
+	struct frameSkip * frameSkip = &gameboy->screen.frameSkip;
+	if (((mode == FRAME_SKIP_FIXED) || (mode == FRAME_SKIP_AUTO)) && (interval < 1)){
+		fprintf(stderr, "Frame skip interval must be at least 1\n");
+		mode = FRAME_SKIP_OFF;
+	}
+	frameSkip->mode = mode;
+	frameSkip->interval = interval;
+	//takes effect from the next frame
+	frameSkip->counter = 0;
+	frameSkip->hostBehind = false;
+	if (mode == FRAME_SKIP_ALL){
+		//except skipping everything, which stops logging now. The lines logged
+		//so far are drawn first, so nothing is left half done
+		renderPendingLines(gameboy);
+		frameSkip->skipping = true;
+	}
+}
 
-				int red = 0;
-				int green = 0;
-				int blue = 0;
+void setHostBehind(struct gameboy * gameboy, bool behind)
+{
+	gameboy->screen.frameSkip.hostBehind = behind;
+}
 
-				switch(colour)
-				{
-					case WHITE: break;
-					case LIGHT_GREY: red = 0xCC; green = 0xCC; blue = 0xCC; break;
-					case DARK_GREY: red = 0x77; green = 0x77; blue = 0x77; break;
-					case BLACK: break;
-				}
+bool takeFrame(struct gameboy * gameboy)
+{
+	//true once for each frame that was drawn, so the host only presents those
+	bool ready = gameboy->screen.frameSkip.frameReady;
+	gameboy->screen.frameSkip.frameReady = false;
+	return ready;
+}
 
-				int xPix = 0 - pixel;
-				xPix += 7;
+bool hasFrameChanged(struct gameboy * gameboy)
+{
+	//for the frame takeFrame last returned - an identical one needn't be
+	//uploaded or presented again
+	return gameboy->screen.frameSkip.frameChanged;
+}
 
-				int pixel = xPos + xPix;
-	
-				gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 0] = red;
-				gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 1] = green;
-				gameboy->screen.frameBufferNew[3 * (gameboy->screen.currentScanline * X + pixel) + 2] = blue;
-	
-					
-			}
-		}
+void beforeSpriteTableWrite(struct gameboy * gameboy)
+{
+	//lines already logged this frame have to be drawn with the old OAM
+	renderPendingLines(gameboy);
+	if (gameboy->screen.renderMode == RENDER_PIXEL_FIFO){
+		catchUpPixelFifo(gameboy);
+	}
+	if (gameboy->screen.spriteCache != NULL){
+		gameboy->screen.spriteCache->dirty = true;
+	}
+	if (gameboy->screen.renderThread != NULL){
+		gameboy->screen.renderThread->spriteTableChanged = true;
+	}
+}
 
+void beforeLCDRegisterWrite(struct gameboy * gameboy)
+{
+	//the scanline renderer has the registers logged already, but the FIFO
+	//reads them as it goes
+	if (gameboy->screen.renderMode == RENDER_PIXEL_FIFO){
+		catchUpPixelFifo(gameboy);
 	}
-				
 }
 
-static bool windowEnabled(struct gameboy * gameboy)
+bool setRenderMode(struct gameboy * gameboy, enum renderMode mode)
 {
-	return isBitSet(gameboy->screen.control, windowDisplayEnable) ? true : false;
+	struct screen * screen = &gameboy->screen;
+	if ((mode == RENDER_PIXEL_FIFO) && gameboy->cartridge.cgb){
+		//the FIFO only knows how to draw DMG lines
+		return false;
+	}
+	if (mode == RENDER_PIXEL_FIFO){
+		//the FIFO has to keep in step with the CPU, so it can't be handed to
+		//the render thread
+		stopRenderThread(gameboy);
+		if (screen->pixelFifo == NULL){
+			screen->pixelFifo = calloc(1, sizeof(struct pixelFifo));
+			if (screen->pixelFifo == NULL){
+				return false;
+			}
+		}
+	}
+
+	//lines logged so far are drawn before switching. The new renderer takes
+	//over from the next line that reaches mode 3
+	renderPendingLines(gameboy);
+	if (screen->frameLog != NULL){
+		int linesDone = screen->currentScanline + ((getCurrentMode(gameboy) == oamRead) ? 0 : 1);
+		screen->frameLog->logged = linesDone;
+		screen->frameLog->rendered = linesDone;
+	}
+	if (screen->pixelFifo != NULL){
+		screen->pixelFifo->drawing = false;
+	}
+	screen->renderMode = mode;
+	return true;
 }
 
-static uint8_t getCurrentMode(struct gameboy * gameboy)
+void invalidateRenderCaches(struct gameboy * gameboy)
 {
-	return gameboy->screen.status & 0x3;
+	//VRAM and OAM changed behind the caches' back (e.g. a reset), so lines
+	//logged against the old contents can't be drawn any more
+	if (gameboy->screen.frameLog != NULL){
+		gameboy->screen.frameLog->rendered = gameboy->screen.frameLog->logged;
+	}
+	if (gameboy->screen.tileCache != NULL){
+		markAllTilesDirty(gameboy->screen.tileCache);
+	}
+	if (gameboy->screen.renderThread != NULL){
+		gameboy->screen.renderThread->videoRamDirty = ALL_VRAM_BLOCKS;
+	}
+	beforeSpriteTableWrite(gameboy);
 }
 
-static void startNewScanline(struct gameboy * gameboy)
+void setShades(struct gameboy * gameboy, const struct colour * shades)
 {
-	//if LCD is disabled, set mode to 1
-	gameboy->screen.scanlineCounter = 0;
-	gameboy->screen.currentScanline = 0;
-	//gameboy->screen.status &= 252; //whats going on?
-	setBit(&gameboy->screen.control, lcdEnable, true);
-	setBit(&gameboy->screen.status, hBlank, true);
+	//the shades are only applied when the frame is converted, so the new
+	//colours show from the next vblank, on every line
+	gameboy->screen.palettes.shades = shades;
+	buildHostShades(&gameboy->screen);
+	gameboy->screen.convertAll = true;
+	updatePalette(gameboy, BG_PALETTE_REG);
+	updatePalette(gameboy, OBJ_PALETTE_0_REG);
+	updatePalette(gameboy, OBJ_PALETTE_1_REG);
 }
 
-/*
-static bool isInHBlankBounds(struct gameboy * gameboy)
-{	
-	//mode 0 - probably won't need this function
-	return true;
+void updatePalette(struct gameboy * gameboy, uint16_t address)
+{
+	//every 2 bits of the register is the shade of a colour ID, ID 0 in bits 1/0
+	struct palettes * palettes = &gameboy->screen.palettes;
+	enum paletteId palette = address - BG_PALETTE_REG;
+	uint8_t data = gameboy->memory.io[address - IO_START];
+	for (int colourNum = 0; colourNum < 4; colourNum++){
+		uint8_t shade = (data >> (colourNum * 2)) & 3;
+		palettes->pixel[palette][colourNum] = shade | (palette << PIXEL_PALETTE_SHIFT);
+	}
 }
-*/
 
-static bool isInVBlankBounds(struct gameboy * gameboy)
+void beforeVideoRamWrite(struct gameboy * gameboy, uint16_t address)
 {
-	//mode 1
-	uint8_t currentScanline = gameboy->screen.currentScanline;
-	return ((currentScanline >= Y) && (currentScanline <= (Y + NO_OF_INVISIBLE_SCANLINES))) ? true : false;
+	//lines already logged this frame have to be drawn with the old VRAM
+	renderPendingLines(gameboy);
+	if (gameboy->screen.renderMode == RENDER_PIXEL_FIFO){
+		catchUpPixelFifo(gameboy);
+	}
+
+	if (gameboy->screen.tileCache != NULL){
+		markTileRowDirty(gameboy->screen.tileCache, gameboy->memory.videoRamBank, address);
+	}
+	if (gameboy->screen.renderThread != NULL){
+		markVideoRamDirty(gameboy, address);
+	}
 }
 
-static bool isInSpriteAttributeBounds(struct gameboy * gameboy)
+int getBytesPerPixel(enum pixelFormat format)
 {
-	//mode 2
-	int currentCounter = gameboy->screen.scanlineCounter;
-	return ((currentCounter >= SPRITE_ATTR_CYCLE_LOWER) && (currentCounter <= SPRITE_ATTR_CYCLE_UPPER)) ? true : false;
+	switch (format){
+		case PIXEL_FORMAT_RGB888:
+			return 3;
+		case PIXEL_FORMAT_RGBA8888:
+		case PIXEL_FORMAT_BGRA8888:
+			return 4;
+		case PIXEL_FORMAT_RGB565:
+			return 2;
+		default:
+			return 1;
+	}
 }
 
-static bool isInDriverTransferBounds(struct gameboy * gameboy)
+bool setPixelFormat(struct gameboy * gameboy, enum pixelFormat format)
 {
-	int currentCounter = gameboy->screen.scanlineCounter;
-	return ((currentCounter >= DRIVER_TRANSFER_CYCLE_LOWER) && (currentCounter <= DRIVER_TRANSFER_CYCLE_UPPER)) ? true : false;
+	struct screen * screen = &gameboy->screen;
+	if (screen->indexBuffer == NULL){
+		screen->indexBuffer = calloc(X * Y, 1);
+		screen->lineHashes = calloc(Y, sizeof(uint64_t));
+		if ((screen->indexBuffer == NULL) || (screen->lineHashes == NULL)){
+			return false;
+		}
+	}
+
+	//indexed hosts read indexBuffer directly, there's nothing to convert to
+	uint8_t * frameBuffer = NULL;
+	uint64_t * convertedHashes = NULL;
+	if (format != PIXEL_FORMAT_INDEXED){
+		frameBuffer = calloc(X * Y, getBytesPerPixel(format));
+		convertedHashes = calloc(Y, sizeof(uint64_t));
+		if ((frameBuffer == NULL) || (convertedHashes == NULL)){
+			free(frameBuffer);
+			free(convertedHashes);
+			return false;
+		}
+	}
+	free(gameboy->screen.frameBuffer);
+	free(gameboy->screen.convertedHashes);
+	gameboy->screen.frameBuffer = frameBuffer;
+	gameboy->screen.convertedHashes = convertedHashes;
+	gameboy->screen.pixelFormat = format;
+	buildHostShades(&gameboy->screen);
+	gameboy->screen.convertAll = true;
+	return true;
 }
 
-static void handleHBlank(struct gameboy * gameboy)
+bool setColourFrames(struct gameboy * gameboy, bool colourFrames)
 {
-	setBit(&gameboy->screen.status, 1, false);
-	setBit(&gameboy->screen.status, 1, true);
-	gameboy->screen.currentLCDInterruptEnabled = isBitSet(gameboy->screen.status, HBLANK_ENABLE_BIT);
+	//the line colours are only kept while CGB frames are being drawn, and the
+	//tile caches only have room for VRAM bank 1 in colour mode. Switching
+	//drops the lines logged for the old mode and the caches sized for it - a
+	//render thread is restarted to build its own again
+	struct screen * screen = &gameboy->screen;
+	bool threaded = screen->renderThread != NULL;
+	if (colourFrames != screen->colourFrames){
+		stopRenderThread(gameboy);
+		if (screen->frameLog != NULL){
+			screen->frameLog->rendered = screen->frameLog->logged;
+		}
+		free(screen->tileCache);
+		screen->tileCache = NULL;
+	}
+	if (colourFrames && (screen->lineColours == NULL)){
+		screen->lineColours = calloc(Y, sizeof(screen->lineColours[0]));
+		screen->loggedColours = calloc(Y, sizeof(screen->loggedColours[0]));
+		if ((screen->lineColours == NULL) || (screen->loggedColours == NULL)){
+			return false;
+		}
+	}
+	else if (!colourFrames){
+		free(screen->lineColours);
+		free(screen->loggedColours);
+		screen->lineColours = NULL;
+		screen->loggedColours = NULL;
+	}
+	screen->colourFrames = colourFrames;
+	screen->convertAll = true;
+	return !threaded || startRenderThread(gameboy);
 }
-//do some refactoring here
-static void handleVBlank(struct gameboy * gameboy)
+
+bool copyScreenBuffers(struct gameboy * parent, struct gameboy * child)
 {
-	setBit(&gameboy->screen.status, 1, false);
-	setBit(&gameboy->screen.status, 0, true); //set lower 2 bits to 01 (mode 1)
-	gameboy->screen.currentLCDInterruptEnabled = isBitSet(gameboy->screen.status, VBLANK_ENABLE_BIT);
+	//the caches are rebuilt from VRAM and OAM the first time the child draws,
+	//and it draws inline until it starts its own render thread. A fork part
+	//way through a frame carries on from the lines the parent has drawn, so
+	//those are drawn first and the child gets the log with them marked done
+	renderPendingLines(parent);
+	child->screen.renderThread = NULL;
+	child->screen.pixelFifo = NULL;
+	child->screen.inspector = NULL;
+	child->screen.tileCache = NULL;
+	child->screen.spriteCache = NULL;
+	child->screen.frameLog = NULL;
+	child->screen.frameBuffer = NULL;
+	child->screen.convertedHashes = NULL;
+	child->screen.lineHashes = NULL;
+	child->screen.lineColours = NULL;
+	child->screen.loggedColours = NULL;
+	child->screen.indexBuffer = malloc(X * Y);
+	child->screen.lineHashes = malloc(Y * sizeof(uint64_t));
+	if ((child->screen.indexBuffer == NULL) || (child->screen.lineHashes == NULL)){
+		freeScreenBuffers(child);
+		return false;
+	}
+	memcpy(child->screen.indexBuffer, parent->screen.indexBuffer, X * Y);
+	memcpy(child->screen.lineHashes, parent->screen.lineHashes, Y * sizeof(uint64_t));
+	if (parent->screen.lineColours != NULL){
+		size_t coloursSize = Y * sizeof(parent->screen.lineColours[0]);
+		child->screen.lineColours = malloc(coloursSize);
+		child->screen.loggedColours = malloc(coloursSize);
+		if ((child->screen.lineColours == NULL) || (child->screen.loggedColours == NULL)){
+			freeScreenBuffers(child);
+			return false;
+		}
+		memcpy(child->screen.lineColours, parent->screen.lineColours, coloursSize);
+		memcpy(child->screen.loggedColours, parent->screen.loggedColours, coloursSize);
+	}
+	if (parent->screen.renderThread != NULL){
+		copyRenderedLines(parent, &child->screen);
+	}
+	if (parent->screen.frameLog != NULL){
+		child->screen.frameLog = malloc(sizeof(struct frameLog));
+		if (child->screen.frameLog == NULL){
+			freeScreenBuffers(child);
+			return false;
+		}
+		memcpy(child->screen.frameLog, parent->screen.frameLog, sizeof(struct frameLog));
+	}
+
+	if (parent->screen.frameBuffer != NULL){
+		size_t size = X * Y * getBytesPerPixel(parent->screen.pixelFormat);
+		child->screen.frameBuffer = malloc(size);
+		child->screen.convertedHashes = malloc(Y * sizeof(uint64_t));
+		if ((child->screen.frameBuffer == NULL) || (child->screen.convertedHashes == NULL)){
+			freeScreenBuffers(child);
+			return false;
+		}
+		memcpy(child->screen.frameBuffer, parent->screen.frameBuffer, size);
+		memcpy(child->screen.convertedHashes, parent->screen.convertedHashes, Y * sizeof(uint64_t));
+	}
+
+	//a fork part way through a line carries on drawing it
+	if (parent->screen.pixelFifo != NULL){
+		child->screen.pixelFifo = malloc(sizeof(struct pixelFifo));
+		if (child->screen.pixelFifo == NULL){
+			freeScreenBuffers(child);
+			return false;
+		}
+		memcpy(child->screen.pixelFifo, parent->screen.pixelFifo, sizeof(struct pixelFifo));
+	}
+	return true;
 }
 
-static void handleSpriteSearch(struct gameboy * gameboy)
+void freeScreenBuffers(struct gameboy * gameboy)
 {
-	setBit(&gameboy->screen.status, 1, true);
-	setBit(&gameboy->screen.status, 0, false); //set lower 2 bits to 10
-	gameboy->screen.currentLCDInterruptEnabled = isBitSet(gameboy->screen.status, SPRITE_ENABLE_BIT);
+	stopRenderThread(gameboy);
+	free(gameboy->screen.tileCache);
+	free(gameboy->screen.spriteCache);
+	free(gameboy->screen.frameLog);
+	free(gameboy->screen.pixelFifo);
+	free(gameboy->screen.inspector);
+	free(gameboy->screen.indexBuffer);
+	free(gameboy->screen.lineHashes);
+	free(gameboy->screen.frameBuffer);
+	free(gameboy->screen.convertedHashes);
+	free(gameboy->screen.lineColours);
+	free(gameboy->screen.loggedColours);
+	gameboy->screen.tileCache = NULL;
+	gameboy->screen.spriteCache = NULL;
+	gameboy->screen.frameLog = NULL;
+	gameboy->screen.pixelFifo = NULL;
+	gameboy->screen.inspector = NULL;
+	gameboy->screen.indexBuffer = NULL;
+	gameboy->screen.lineHashes = NULL;
+	gameboy->screen.frameBuffer = NULL;
+	gameboy->screen.convertedHashes = NULL;
+	gameboy->screen.lineColours = NULL;
+	gameboy->screen.loggedColours = NULL;
 }
 
-static void handleTransferToLCDDriver(struct gameboy * gameboy)
+static uint8_t getCurrentMode(struct gameboy * gameboy)
 {
-	setBit(&gameboy->screen.status, 1, true);
-	setBit(&gameboy->screen.status, 0, true); //set lower 2 bits to 11
-	//this doesn't request an interrupt
+	return gameboy->screen.status & STATUS_MODE_MASK;
 }
 
@@ -18,6 +18,11 @@ int main(void)
 	
 	struct gameboy * gameboy;
 	gameboy = createGameboy();
+	//the display converts frames as it scales them, so the core only draws the indices
+	if ((gameboy == NULL) || !setPixelFormat(gameboy, PIXEL_FORMAT_INDEXED)){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		return -1;
+	}
 	loadGame(gameboy, "../games/sml.gb");
 	startDisplay();
 
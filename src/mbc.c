@@ -3,7 +3,6 @@
 #include <string.h>
 #include <stdio.h>
 
-static void initialiseBankZero(struct gameboy * gameboy, int size);
 static void initialiseRomOnly(struct gameboy * gameboy);
 static void initialiseMBC1(struct gameboy * gameboy);
 static void initialiseMBC2(struct gameboy * gameboy);
@@ -16,6 +15,10 @@ void initialiseRomBanks(struct gameboy * gameboy)
 	//switch statement to see what initialisation function to run
 	//change this to an array of function pointers as support for different 
 	//bank methods increases
+	gameboy->cartridge.currentROMBank = 1;
+	gameboy->cartridge.currentRAMBank = 0;
+	gameboy->cartridge.romBanking = true;
+	gameboy->cartridge.ramEnabled = false;
 
 	switch(gameboy->cartridge.bankMode){
 		case ROM_ONLY:
@@ -35,44 +38,42 @@ void initialiseRomBanks(struct gameboy * gameboy)
 			break;
 		default:
 			printf("Unsupported MBC type %d\n", gameboy->cartridge.bankMode);
+			initialiseMBC1(gameboy);
 			break;
 	}
+
+	mapRAMBank(gameboy);
 }
 
 static void initialiseRomOnly(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, ROM_ONLY_CARTRIDGE_SIZE);
+	//no banking - 0000-7FFF is just the first 32kB of the cart
+	mapROMBank(gameboy);
 }
 
 static void initialiseMBC1(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, BANK_ZERO_SIZE);
+	mapROMBank(gameboy);
 }
 
 static void initialiseMBC2(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, BANK_ZERO_SIZE);
+	mapROMBank(gameboy);
 }
 
 /*
 static void initialiseMBC3(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, BANK_ZERO_SIZE);
+	mapROMBank(gameboy);
 }
 
 static void initialiseMBC4(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, BANK_ZERO_SIZE);
+	mapROMBank(gameboy);
 }
 
 static void initialiseMBC5(struct gameboy * gameboy)
 {
-	initialiseBankZero(gameboy, BANK_ZERO_SIZE);
+	mapROMBank(gameboy);
 }
 */
-
-static void initialiseBankZero(struct gameboy * gameboy, int size)
-{
-	//copy first 16kB of cartridge to 0000-3FFF
-	memcpy(&gameboy->memory.mem, &gameboy->cartridge.memory, size);
-}
@@ -3,9 +3,12 @@
 #include "../include/dma.h"
 #include "../include/joypad.h"
 #include "../include/debug.h"
+#include "../include/bitUtils.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
 
 static void handleBankWrite(struct gameboy * gameboy, uint16_t address, uint8_t data);
 static void handleMBC1RAMBankToggle(struct gameboy * gameboy, uint8_t data);
@@ -13,33 +16,74 @@ static void handleMBC1LowROMBankNumber(struct gameboy * gameboy, uint8_t data);
 static void handleMBC1HighROMBankNumber(struct gameboy * gameboy, uint8_t data);
 static void handleMBC1ROMRAMModeSelect(struct gameboy * gameboy, uint8_t data);
 static void handleRAMBankChange(struct gameboy * gameboy, uint8_t data);
+static void writeIO(struct gameboy * gameboy, uint16_t address, uint8_t data);
+static uint8_t readIO(struct gameboy * gameboy, uint16_t address);
+static struct page ** getRAMPageSlot(struct gameboy * gameboy, uint16_t address);
+static struct page * copyPageOnWrite(struct gameboy * gameboy, struct page ** slot, uint16_t address);
+static void mapRAMPages(struct gameboy * gameboy);
+static void mapPage(struct memory * memory, int index, struct page * page, bool writable);
+static struct page * replaceWithBlankPage(struct page ** slot);
+static void setVideoRamBank(struct gameboy * gameboy, uint8_t data);
+static void setWorkRamBank(struct gameboy * gameboy, uint8_t data);
 
 void writeByte(struct gameboy * gameboy, uint16_t address, uint8_t data)
 {
+	//plain RAM is mapped straight into the write map
+	uint8_t * page = gameboy->memory.writeMap[address >> PAGE_SHIFT];
+	if ((page != NULL) && !gameboy->dma.active){
+		page[address & PAGE_MASK] = data;
+		return;
+	}
+
+	if (isDMABlockingBus(gameboy, address)){
+		return;
+	}
+
+	//RAM that is still shared with a forked instance, or the top of echo RAM
+	//(F000-FDFF) which shares the 0xF000 page with OAM and I/O
+	struct page ** slot = getRAMPageSlot(gameboy, address);
+	if (slot != NULL){
+		if ((address >= VRAM_START) && (address < RAM_BANK_START)){
+			//VRAM is never in the write map, so the renderer sees every write
+			beforeVideoRamWrite(gameboy, address);
+		}
+		copyPageOnWrite(gameboy, slot, address)->data[address & PAGE_MASK] = data;
+		return;
+	}
+
 	//0000-8000 is read only
 	if (address < CARTRIDGE_SIZE){
 		handleBankWrite(gameboy, address, data);
 	}
-	//anything written to echo RAM should be written to work RAM.
-	else if ((address >= ECHO_RAM_START_UPPER) && (address < ECHO_RAM_END_UPPER)){
-		gameboy->memory.mem[address] = data;
-		gameboy->memory.mem[address - ECHO_OFFSET] = data;
+	else if (address < ECHO_RAM_END_UPPER){
+		//external RAM that is disabled or not present - the write goes nowhere
 	}
-	else if ((address >= ECHO_RAM_START_LOWER) && (address < ECHO_RAM_END_LOWER)){
-		gameboy->memory.mem[address] = data;
-		gameboy->memory.mem[address + ECHO_OFFSET] = data;
+	else if (address < RESTRICTED_START){
+		beforeSpriteTableWrite(gameboy);
+		gameboy->memory.spriteTable[address - SPRITE_RAM_START] = data;
 	}
-	else if ((address >= RESTRICTED_START) && (address < RESTRICTED_END)){
+	else if (address < IO_START){
 		//printf("sp: %x\n", gameboy->cpu.sp);
 		//printf("WriteMemory: address %x is within restricted memory %x - %x\n", address, RESTRICTED_START, RESTRICTED_END);
 	//	fprintf(stderr, "WriteMemory: address %x is within restricted memory %x - %x\n", address, RESTRICTED_START, RESTRICTED_END);
 		//printDebugTrace(gameboy);
 		
 	}
-	else if (address == TMC){
+	else {
+		writeIO(gameboy, address, data);
+	}
+
+}
+
+static void writeIO(struct gameboy * gameboy, uint16_t address, uint8_t data)
+{
+	if ((address >= CONTROL_REG) && (address <= LCD_REG_END)){
+		beforeLCDRegisterWrite(gameboy);
+	}
+	if (address == TMC){
 		//the game is trying to change the timer controller
 		int currentFreq = getTimerFrequency(gameboy);
-		gameboy->memory.mem[TMC] = data;
+		gameboy->memory.io[TMC - IO_START] = data;
 		int newFreq = getTimerFrequency(gameboy);
 		if (newFreq != currentFreq){
 			initialiseTimerCounter(gameboy);
@@ -47,25 +91,46 @@ void writeByte(struct gameboy * gameboy, uint16_t address, uint8_t data)
 	}
 	else if (address == DIV_REG){
 		//any writes to the divider register resets it to 0
-		gameboy->memory.mem[DIV_REG] = 0;
+		gameboy->memory.io[DIV_REG - IO_START] = 0;
 	}
 	else if (address == DMA_ADDRESS){
 		doDMATransfer(gameboy, data);
 	}
 	else if (address == CONTROL_REG){
-		gameboy->screen.control = data;
+		setLCDControl(gameboy, data);
 	}
 	else if (address == CURRENT_SCANLINE){
-		//printf("resetting scanline\n");
-		gameboy->screen.currentScanline = 0;
+		resetScanline(gameboy);
 	}
 	else if (address == STATUS_REG){
-		gameboy->screen.status = data;
+		setLCDStatus(gameboy, data);
+	}
+	else if ((address >= BG_PALETTE_REG) && (address <= OBJ_PALETTE_1_REG)){
+		gameboy->memory.io[address - IO_START] = data;
+		updatePalette(gameboy, address);
+	}
+	else if (!gameboy->cartridge.cgb){
+		//the colour registers below are plain bytes on a DMG
+		gameboy->memory.io[address - IO_START] = data;
+	}
+	else if (address == VRAM_BANK_REG){
+		setVideoRamBank(gameboy, data);
+	}
+	else if (address == WORK_RAM_BANK_REG){
+		setWorkRamBank(gameboy, data);
+	}
+	else if (address == SPEED_SWITCH_REG){
+		gameboy->cpu.speedSwitchArmed = isBitSet(data, 0);
+	}
+	else if (address == HDMA_CONTROL_REG){
+		startHDMA(gameboy, data);
+	}
+	else if ((address >= BG_COLOUR_INDEX_REG) && (address <= OBJ_COLOUR_DATA_REG)){
+		writeColourPalette(gameboy, address, data);
 	}
 	else {
-		gameboy->memory.mem[address] = data;
+		gameboy->memory.io[address - IO_START] = data;
 	}
-
 }
 
 void writeWord(struct gameboy * gameboy, uint16_t address, uint16_t data)
@@ -121,6 +186,7 @@ static void handleMBC1RAMBankToggle(struct gameboy * gameboy, uint8_t data)
 	else {
 		gameboy->cartridge.ramEnabled = false;
 	}
+	mapRAMBank(gameboy);
 }
 
 static void handleMBC1LowROMBankNumber(struct gameboy * gameboy, uint8_t data)
@@ -132,6 +198,7 @@ static void handleMBC1LowROMBankNumber(struct gameboy * gameboy, uint8_t data)
 	if (gameboy->cartridge.currentROMBank == 0){
 		gameboy->cartridge.currentROMBank++;
 	}
+	mapROMBank(gameboy);
 }
 
 static void handleMBC1HighROMBankNumber(struct gameboy * gameboy, uint8_t data)
@@ -147,12 +214,14 @@ static void handleMBC1HighROMBankNumber(struct gameboy * gameboy, uint8_t data)
 	if (gameboy->cartridge.currentROMBank == 0){
 		gameboy->cartridge.currentROMBank++;
 	}
+	mapROMBank(gameboy);
 }
 
 static void handleRAMBankChange(struct gameboy * gameboy, uint8_t data)
 {
 	//RAM bank changes when writing to 0x4000-0x6000 but ROM banking is false
 	gameboy->cartridge.currentRAMBank = data & 0x3; //currentRAMBank gets set to lower 2 bits of incoming data
+	mapRAMBank(gameboy);
 }
 
 static void handleMBC1ROMRAMModeSelect(struct gameboy * gameboy, uint8_t data)
@@ -164,6 +233,7 @@ static void handleMBC1ROMRAMModeSelect(struct gameboy * gameboy, uint8_t data)
 	gameboy->cartridge.romBanking = (lsb == 0) ? true : false;
 	if (gameboy->cartridge.romBanking){
 		gameboy->cartridge.currentRAMBank = 0;
+		mapRAMBank(gameboy);
 	}
 
 }
@@ -171,23 +241,37 @@ static void handleMBC1ROMRAMModeSelect(struct gameboy * gameboy, uint8_t data)
 uint8_t readByte(struct gameboy * gameboy, uint16_t address)
 {
 	//certain reads reset certain timers, implement this later
-	//sort out ram/rom banks
 
-	//memory range 0x4000 - 7FFF contain the ROM banks for each MBC type
-	//do MBC reads here
-	//don't need this if no MBC is present in the cart
-	if ((address >= MBANK_START) && (address <= MBANK_END)){
-		//if its in this range, get memory from cartridge
-		return gameboy->cartridge.memory[(address - MBANK_START) + (gameboy->cartridge.currentROMBank * MBANK_START)];
+	//ROM (through the current bank), VRAM and RAM are all in the read map
+	const uint8_t * page = gameboy->memory.readMap[address >> PAGE_SHIFT];
+	if ((page != NULL) && !gameboy->dma.active){
+		return page[address & PAGE_MASK];
 	}
-	else if ((address >= RAM_BANK_START) && (address <= RAM_BANK_END)){
-		//for MBC1, A000-BFFF contains RAM Bank 00-03, if they exist.
-		//for the time being, read from a RAM bank array.
-		//if each bank is 0x2000 kb, and there is a max of 4 banks, then
-		//the ram bank array is 0x8000 kb in size.
-		return gameboy->cartridge.ramBanks[(address - RAM_BANK_START) + (gameboy->cartridge.currentRAMBank * RAM_BANK_SIZE)];
+
+	if (isDMABlockingBus(gameboy, address)){
+		return 0xFF;
 	}
-	else if (address == CURRENT_SCANLINE){
+	else if (address < ECHO_RAM_START_UPPER){
+		//no cartridge loaded, or external RAM disabled/not present
+		return 0xFF;
+	}
+	else if (address < ECHO_RAM_END_UPPER){
+		return gameboy->memory.readMap[(address - ECHO_OFFSET) >> PAGE_SHIFT][address & PAGE_MASK];
+	}
+	else if (address < RESTRICTED_START){
+		return gameboy->memory.spriteTable[address - SPRITE_RAM_START];
+	}
+	else if (address < IO_START){
+		return 0;
+	}
+
+	return readIO(gameboy, address);
+
+}
+
+static uint8_t readIO(struct gameboy * gameboy, uint16_t address)
+{
+	if (address == CURRENT_SCANLINE){
 		//printf("Reading scanline\n");
 		return gameboy->screen.currentScanline;
 	}
@@ -195,7 +279,7 @@ uint8_t readByte(struct gameboy * gameboy, uint16_t address)
 		//look at data in memory address JOYPAD_REG (0xFF00)
 		//see if the game is interested in directional or standard buttons
 		//set joypad state as necessary
-		return gameboy->memory.mem[address]; // try this
+		return gameboy->memory.io[JOYPAD_REG - IO_START]; // try this
 	}
 	else if (address == CONTROL_REG){
 		return gameboy->screen.control;
@@ -203,9 +287,26 @@ uint8_t readByte(struct gameboy * gameboy, uint16_t address)
 	else if (address == STATUS_REG){
 		return gameboy->screen.status;
 	}
+	else if (!gameboy->cartridge.cgb){
+		return gameboy->memory.io[address - IO_START];
+	}
+	else if (address == VRAM_BANK_REG){
+		return 0xFE | gameboy->memory.videoRamBank;
+	}
+	else if (address == WORK_RAM_BANK_REG){
+		return 0xF8 | gameboy->memory.workRamBank;
+	}
+	else if (address == SPEED_SWITCH_REG){
+		return 0x7E | (gameboy->cpu.doubleSpeed ? 0x80 : 0) | (gameboy->cpu.speedSwitchArmed ? 1 : 0);
+	}
+	else if (address == HDMA_CONTROL_REG){
+		return getHDMAStatus(gameboy);
+	}
+	else if ((address == BG_COLOUR_DATA_REG) || (address == OBJ_COLOUR_DATA_REG)){
+		return readColourPalette(gameboy, address);
+	}
 
-	return gameboy->memory.mem[address];
-
+	return gameboy->memory.io[address - IO_START];
 }
 
 uint16_t readWord(struct gameboy * gameboy, uint16_t address)
@@ -215,4 +316,379 @@ uint16_t readWord(struct gameboy * gameboy, uint16_t address)
 	return result;
 }
 
+const uint8_t * getMemoryBlock(struct gameboy * gameboy, uint16_t address)
+{
+	const uint8_t * page = gameboy->memory.readMap[address >> PAGE_SHIFT];
+	if (page != NULL){
+		return &page[address & PAGE_MASK];
+	}
+	else if ((address >= ECHO_RAM_START_UPPER) && (address < ECHO_RAM_END_UPPER)){
+		return &gameboy->memory.readMap[(address - ECHO_OFFSET) >> PAGE_SHIFT][address & PAGE_MASK];
+	}
+	else if ((address >= SPRITE_RAM_START) && (address < RESTRICTED_START)){
+		return &gameboy->memory.spriteTable[address - SPRITE_RAM_START];
+	}
+	else if (address >= IO_START){
+		return &gameboy->memory.io[address - IO_START];
+	}
+
+	return NULL;
+}
+
+void writeVideoRamBlock(struct gameboy * gameboy, uint16_t address, const uint8_t * data, int length)
+{
+	//HDMA's fast path - one copy-on-write check and one copy for the block,
+	//rather than a trip through writeByte for every byte
+	for (int offset = 0; offset < length; offset += 2){
+		beforeVideoRamWrite(gameboy, address + offset);
+	}
+	struct page ** slot = getRAMPageSlot(gameboy, address);
+	memcpy(&copyPageOnWrite(gameboy, slot, address)->data[address & PAGE_MASK], data, length);
+}
+
+void writeRAMBank(struct gameboy * gameboy, uint16_t address, uint8_t bank, uint8_t data)
+{
+	//the bank picks the external RAM bank at A000-BFFF or the work RAM bank at
+	//D000-DFFF, and is ignored at C000-CFFF. Nothing is switched in
+	struct page ** slot = NULL;
+	if ((address >= RAM_BANK_START) && (address <= RAM_BANK_END)){
+		if (gameboy->cartridge.ramPages == NULL){
+			return;
+		}
+		int bankNumber = bank % gameboy->cartridge.ramBankCount;
+		slot = &gameboy->cartridge.ramPages[(bankNumber * PAGES_PER_RAM_BANK) + ((address - RAM_BANK_START) >> PAGE_SHIFT)];
+	}
+	else if ((address >= WORK_RAM_START) && (address < ECHO_RAM_START_UPPER)){
+		//as with SVBK, bank 0 means bank 1 at D000
+		bool switchable = ((address - WORK_RAM_START) >> PAGE_SHIFT) % NO_OF_WORK_RAM_PAGES;
+		uint8_t workBank = bank % NO_OF_WORK_RAM_BANKS;
+		slot = &gameboy->memory.workRam[switchable ? ((workBank == 0) ? 1 : workBank) : 0];
+	}
+	if ((slot == NULL) || (*slot == NULL)){
+		//not RAM, or a colour bank a DMG game doesn't have
+		return;
+	}
+	copyPageOnWrite(gameboy, slot, address)->data[address & PAGE_MASK] = data;
+}
+
+void initialiseMemoryMap(struct gameboy * gameboy)
+{
+	struct memory * memory = &gameboy->memory;
+	for (int page = 0; page < NO_OF_PAGES; page++){
+		memory->readMap[page] = NULL;
+		memory->writeMap[page] = NULL;
+	}
+
+	mapRAMPages(gameboy);
+	mapROMBank(gameboy);
+}
+
+static void mapRAMPages(struct gameboy * gameboy)
+{
+	struct memory * memory = &gameboy->memory;
+	if (memory->videoRam[0] == NULL){
+		//not allocated yet
+		return;
+	}
+
+	struct page ** videoRam = &memory->videoRam[memory->videoRamBank * NO_OF_VRAM_PAGES];
+	for (int i = 0; i < NO_OF_VRAM_PAGES; i++){
+		mapPage(memory, (VRAM_START >> PAGE_SHIFT) + i, videoRam[i], false);
+	}
+
+	//C000-DFFF, plus E000-EFFF which echoes C000-CFFF
+	int workRamPage = WORK_RAM_START >> PAGE_SHIFT;
+	mapPage(memory, workRamPage, memory->workRam[0], true);
+	mapPage(memory, workRamPage + 1, memory->workRam[memory->workRamBank], true);
+	mapPage(memory, workRamPage + 2, memory->workRam[0], true);
+
+	mapRAMBank(gameboy);
+}
+
+static void mapPage(struct memory * memory, int index, struct page * page, bool writable)
+{
+	memory->readMap[index] = page->data;
+	//shared pages stay out of the write map until they've been copied
+	writable = writable && (atomic_load(&page->refCount) == 1);
+	memory->writeMap[index] = writable ? page->data : NULL;
+}
+
+void mapROMBank(struct gameboy * gameboy)
+{
+	//0000-3FFF is always bank 0, 4000-7FFF is the switchable bank
+	const uint8_t * rom = gameboy->cartridge.memory;
+	if (rom == NULL){
+		return;
+	}
+
+	for (int page = 0; page < (MBANK_START >> PAGE_SHIFT); page++){
+		gameboy->memory.readMap[page] = &rom[page << PAGE_SHIFT];
+	}
+
+	int bank = gameboy->cartridge.currentROMBank % gameboy->cartridge.romBankCount;
+	for (int i = 0; i < (ROM_BANK_SIZE >> PAGE_SHIFT); i++){
+		int page = (MBANK_START >> PAGE_SHIFT) + i;
+		gameboy->memory.readMap[page] = &rom[(bank * ROM_BANK_SIZE) + (i << PAGE_SHIFT)];
+	}
+
+	//Game Genie patched pages stand in for the originals
+	mapPatchedPages(gameboy);
+}
+
+void mapRAMBank(struct gameboy * gameboy)
+{
+	//A000-BFFF - external RAM is only reachable while it is enabled
+	struct page ** bank = NULL;
+	if (gameboy->cartridge.ramEnabled && (gameboy->cartridge.ramPages != NULL)){
+		int bankNumber = gameboy->cartridge.currentRAMBank % gameboy->cartridge.ramBankCount;
+		bank = &gameboy->cartridge.ramPages[bankNumber * PAGES_PER_RAM_BANK];
+	}
+
+	for (int i = 0; i < PAGES_PER_RAM_BANK; i++){
+		int index = (RAM_BANK_START >> PAGE_SHIFT) + i;
+		if (bank != NULL){
+			mapPage(&gameboy->memory, index, bank[i], true);
+		}
+		else {
+			gameboy->memory.readMap[index] = gameboy->memory.writeMap[index] = NULL;
+		}
+	}
+}
+
+struct page * allocatePage()
+{
+	struct page * page = calloc(1, sizeof(struct page));
+	if (page != NULL){
+		atomic_init(&page->refCount, 1);
+	}
+	return page;
+}
+
+void releasePage(struct page * page)
+{
+	if ((page != NULL) && (atomic_fetch_sub(&page->refCount, 1) == 1)){
+		free(page);
+	}
+}
+
+bool allocateMemory(struct gameboy * gameboy)
+{
+	//just what a DMG sees - the CGB banks wait for a colour game
+	struct memory * memory = &gameboy->memory;
+	for (int i = 0; i < NO_OF_VRAM_PAGES; i++){
+		memory->videoRam[i] = allocatePage();
+	}
+	for (int i = 0; i < NO_OF_DMG_WORK_RAM_BANKS; i++){
+		memory->workRam[i] = allocatePage();
+	}
+	memory->videoRamBank = 0;
+	memory->workRamBank = 1;
+
+	for (int i = 0; i < NO_OF_VRAM_PAGES; i++){
+		if (memory->videoRam[i] == NULL){
+			freeMemory(gameboy);
+			return false;
+		}
+	}
+	for (int i = 0; i < NO_OF_DMG_WORK_RAM_BANKS; i++){
+		if (memory->workRam[i] == NULL){
+			freeMemory(gameboy);
+			return false;
+		}
+	}
+
+	initialiseMemoryMap(gameboy);
+	return true;
+}
+
+bool allocateColourBanks(struct gameboy * gameboy)
+{
+	//VRAM bank 1 and work RAM banks 2-7. Anything already there is kept
+	struct memory * memory = &gameboy->memory;
+	for (int i = NO_OF_VRAM_PAGES; i < TOTAL_VRAM_PAGES; i++){
+		if (memory->videoRam[i] == NULL){
+			memory->videoRam[i] = allocatePage();
+			if (memory->videoRam[i] == NULL){
+				return false;
+			}
+		}
+	}
+	for (int i = NO_OF_DMG_WORK_RAM_BANKS; i < NO_OF_WORK_RAM_BANKS; i++){
+		if (memory->workRam[i] == NULL){
+			memory->workRam[i] = allocatePage();
+			if (memory->workRam[i] == NULL){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void freeColourBanks(struct gameboy * gameboy)
+{
+	//back to what a DMG has, with banks 0 and 1 mapped
+	struct memory * memory = &gameboy->memory;
+	for (int i = NO_OF_VRAM_PAGES; i < TOTAL_VRAM_PAGES; i++){
+		releasePage(memory->videoRam[i]);
+		memory->videoRam[i] = NULL;
+	}
+	for (int i = NO_OF_DMG_WORK_RAM_BANKS; i < NO_OF_WORK_RAM_BANKS; i++){
+		releasePage(memory->workRam[i]);
+		memory->workRam[i] = NULL;
+	}
+	memory->videoRamBank = 0;
+	memory->workRamBank = 1;
+	mapRAMPages(gameboy);
+}
+
+void clearMemory(struct gameboy * gameboy)
+{
+	//pages still shared with another instance are swapped for blank ones
+	//rather than being cleared under the other instance's feet
+	struct memory * memory = &gameboy->memory;
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		if (memory->videoRam[i] != NULL){
+			replaceWithBlankPage(&memory->videoRam[i]);
+		}
+	}
+	for (int i = 0; i < NO_OF_WORK_RAM_BANKS; i++){
+		if (memory->workRam[i] != NULL){
+			replaceWithBlankPage(&memory->workRam[i]);
+		}
+	}
+	memory->videoRamBank = 0;
+	memory->workRamBank = 1;
+	memset(memory->spriteTable, 0, sizeof(memory->spriteTable));
+	invalidateRenderCaches(gameboy);
+	memset(memory->io, 0, sizeof(memory->io));
+	initialiseMemoryMap(gameboy);
+}
 
+void freeMemory(struct gameboy * gameboy)
+{
+	struct memory * memory = &gameboy->memory;
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		releasePage(memory->videoRam[i]);
+		memory->videoRam[i] = NULL;
+	}
+	for (int i = 0; i < NO_OF_WORK_RAM_BANKS; i++){
+		releasePage(memory->workRam[i]);
+		memory->workRam[i] = NULL;
+	}
+}
+
+bool shareMemory(struct gameboy * parent, struct gameboy * child)
+{
+	//child starts out as a byte copy of parent - give it its own page table
+	//pointing at the same pages, and bump the reference counts
+	int noOfRamPages = parent->cartridge.ramBankCount * PAGES_PER_RAM_BANK;
+	if (parent->cartridge.ramPages != NULL){
+		child->cartridge.ramPages = malloc(noOfRamPages * sizeof(struct page *));
+		if (child->cartridge.ramPages == NULL){
+			return false;
+		}
+		for (int i = 0; i < noOfRamPages; i++){
+			child->cartridge.ramPages[i] = parent->cartridge.ramPages[i];
+			atomic_fetch_add(&child->cartridge.ramPages[i]->refCount, 1);
+		}
+	}
+
+	//a DMG instance has no CGB banks to share
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		if (child->memory.videoRam[i] != NULL){
+			atomic_fetch_add(&child->memory.videoRam[i]->refCount, 1);
+		}
+	}
+	for (int i = 0; i < NO_OF_WORK_RAM_BANKS; i++){
+		if (child->memory.workRam[i] != NULL){
+			atomic_fetch_add(&child->memory.workRam[i]->refCount, 1);
+		}
+	}
+	retainRomImage(child->cartridge.romImage);
+
+	//everything is shared now, so both sides lose write access until they copy
+	initialiseMemoryMap(parent);
+	initialiseMemoryMap(child);
+	return true;
+}
+
+static struct page ** getRAMPageSlot(struct gameboy * gameboy, uint16_t address)
+{
+	struct memory * memory = &gameboy->memory;
+	if ((address >= VRAM_START) && (address < RAM_BANK_START)){
+		return &memory->videoRam[(memory->videoRamBank * NO_OF_VRAM_PAGES) + ((address - VRAM_START) >> PAGE_SHIFT)];
+	}
+	else if ((address >= RAM_BANK_START) && (address <= RAM_BANK_END)){
+		if (!gameboy->cartridge.ramEnabled || (gameboy->cartridge.ramPages == NULL)){
+			return NULL;
+		}
+		int bankNumber = gameboy->cartridge.currentRAMBank % gameboy->cartridge.ramBankCount;
+		int page = (bankNumber * PAGES_PER_RAM_BANK) + ((address - RAM_BANK_START) >> PAGE_SHIFT);
+		return &gameboy->cartridge.ramPages[page];
+	}
+	else if ((address >= WORK_RAM_START) && (address < ECHO_RAM_END_UPPER)){
+		//work RAM and its echo - odd pages are the switchable bank
+		bool switchable = ((address - WORK_RAM_START) >> PAGE_SHIFT) % NO_OF_WORK_RAM_PAGES;
+		return &memory->workRam[switchable ? memory->workRamBank : 0];
+	}
+
+	return NULL;
+}
+
+static struct page * copyPageOnWrite(struct gameboy * gameboy, struct page ** slot, uint16_t address)
+{
+	struct page * page = *slot;
+	bool copied = false;
+	if (atomic_load(&page->refCount) > 1){
+		struct page * copy = allocatePage();
+		if (copy == NULL){
+			fprintf(stderr, "Out of memory copying a shared page\n");
+			exit(-1);
+		}
+		memcpy(copy->data, page->data, PAGE_SIZE);
+		releasePage(page);
+		*slot = copy;
+		page = copy;
+		copied = true;
+	}
+
+	//VRAM and the 0xF000 page always come through here. Anything else is
+	//here because it was shared - now it's ours alone, put it back in the map
+	int index = address >> PAGE_SHIFT;
+	bool alwaysSlow = (index == NO_OF_PAGES - 1) || ((address >= VRAM_START) && (address < RAM_BANK_START));
+	if (copied || (!alwaysSlow && (gameboy->memory.writeMap[index] == NULL))){
+		mapRAMPages(gameboy);
+	}
+	return page;
+}
+
+static struct page * replaceWithBlankPage(struct page ** slot)
+{
+	if (atomic_load(&(*slot)->refCount) == 1){
+		memset((*slot)->data, 0, PAGE_SIZE);
+		return *slot;
+	}
+
+	struct page * blank = allocatePage();
+	if (blank == NULL){
+		fprintf(stderr, "Out of memory clearing a shared page\n");
+		exit(-1);
+	}
+	releasePage(*slot);
+	*slot = blank;
+	return blank;
+}
+
+static void setVideoRamBank(struct gameboy * gameboy, uint8_t data)
+{
+	gameboy->memory.videoRamBank = data & 1;
+	mapRAMPages(gameboy);
+}
+
+static void setWorkRamBank(struct gameboy * gameboy, uint8_t data)
+{
+	//bank 0 can't be selected at D000 - it maps bank 1 instead
+	uint8_t bank = data & (NO_OF_WORK_RAM_BANKS - 1);
+	gameboy->memory.workRamBank = (bank == 0) ? 1 : bank;
+	mapRAMPages(gameboy);
+}
@@ -0,0 +1,345 @@
+#include "../include/pixelFifo.h"
+#include "../include/gameboy.h"
+#include "../include/bitUtils.h"
+#include "../include/memory.h"
+#include "../include/tileDecode.h"
+#include "../include/renderer.h"
+#include <string.h>
+
+static void latchRegisters(struct gameboy * gameboy, struct pixelFifo * fifo);
+static void selectSprites(struct gameboy * gameboy, struct pixelFifo * fifo);
+static void stepDot(struct gameboy * gameboy, struct pixelFifo * fifo);
+static bool windowStartsHere(struct pixelFifo * fifo);
+static void startWindow(struct gameboy * gameboy, struct pixelFifo * fifo);
+static bool spritePending(struct pixelFifo * fifo);
+static bool fetcherIdle(struct pixelFifo * fifo);
+static void advanceFetcher(struct gameboy * gameboy, struct pixelFifo * fifo);
+static void fetchSprite(struct gameboy * gameboy, struct pixelFifo * fifo);
+static void outputPixel(struct gameboy * gameboy, struct pixelFifo * fifo);
+static void readFetchStep(struct gameboy * gameboy, struct pixelFifo * fifo);
+static uint16_t getTileRowAddress(struct pixelFifo * fifo);
+static uint8_t readVideoByte(struct gameboy * gameboy, uint16_t address);
+
+void startFifoLine(struct gameboy * gameboy, int startCycle)
+{
+	struct pixelFifo * fifo = gameboy->screen.pixelFifo;
+	memset(fifo, 0, sizeof(struct pixelFifo));
+	fifo->drawing = true;
+	fifo->drawPixels = !gameboy->screen.frameSkip.skipping;
+	fifo->line = gameboy->screen.currentScanline;
+	fifo->startCycle = startCycle;
+	fifo->stall = FIRST_FETCH_DOTS;
+	fifo->windowYReached = gameboy->screen.windowYReached;
+	latchRegisters(gameboy, fifo);
+	fifo->discard = fifo->scrollX % TILE_SIZE;
+	selectSprites(gameboy, fifo);
+}
+
+void catchUpPixelFifo(struct gameboy * gameboy)
+{
+	struct pixelFifo * fifo = gameboy->screen.pixelFifo;
+	if ((fifo == NULL) || !fifo->drawing){
+		return;
+	}
+
+	latchRegisters(gameboy, fifo);
+	int target = gameboy->cpu.cycles - fifo->startCycle;
+	while ((fifo->x < X) && (fifo->dots < target)){
+		stepDot(gameboy, fifo);
+	}
+	if (fifo->x == X){
+		fifo->drawing = false;
+		if (fifo->drawPixels){
+			gameboy->screen.lineHashes[fifo->line] = hashLine(&gameboy->screen.indexBuffer[fifo->line * X], NULL);
+		}
+	}
+}
+
+bool finishFifoTransfer(struct gameboy * gameboy)
+{
+	//true once the whole line is out - mode 3 is over
+	catchUpPixelFifo(gameboy);
+	return (gameboy->screen.pixelFifo == NULL) || !gameboy->screen.pixelFifo->drawing;
+}
+
+int getFifoPixelsLeft(struct gameboy * gameboy)
+{
+	//at most one pixel goes out a dot, so mode 3 can't end any sooner than this
+	return X - gameboy->screen.pixelFifo->x;
+}
+
+static void latchRegisters(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	uint8_t control = gameboy->screen.control;
+	fifo->scrollY = gameboy->memory.io[SCROLL_Y - IO_START];
+	fifo->scrollX = gameboy->memory.io[SCROLL_X - IO_START];
+	fifo->windowX = gameboy->memory.io[WINDOW_POS_X - IO_START];
+	fifo->backgroundEnabled = isBitSet(control, bgDisplayEnable);
+	fifo->windowEnabled = isBitSet(control, windowDisplayEnable);
+	fifo->spritesEnabled = isBitSet(control, spriteEnable);
+	fifo->tallSprites = isBitSet(control, spriteSize);
+	fifo->unsignedTiles = isBitSet(control, 4);
+	fifo->backgroundMap = isBitSet(control, 3) ? 0x9C00 : 0x9800;
+	fifo->windowMap = isBitSet(control, 6) ? 0x9C00 : 0x9800;
+}
+
+static void selectSprites(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	//the first 10 sprites in OAM order on the line, fetched in X order (OAM
+	//order for ties) so the one with the smallest X ends up on top
+	int height = fifo->tallSprites ? 16 : 8;
+	const uint8_t * spriteTable = gameboy->memory.spriteTable;
+	for (int sprite = 0; (sprite < NO_OF_SPRITES) && (fifo->lineSpriteCount < MAX_SPRITES_PER_LINE); sprite++){
+		int yPos = spriteTable[sprite * BYTES_PER_SPRITE] - 16;
+		if ((fifo->line < yPos) || (fifo->line >= yPos + height)){
+			continue;
+		}
+
+		uint8_t xPos = spriteTable[(sprite * BYTES_PER_SPRITE) + 1];
+		int slot = fifo->lineSpriteCount;
+		while ((slot > 0) && (fifo->lineSpriteX[slot - 1] > xPos)){
+			fifo->lineSprites[slot] = fifo->lineSprites[slot - 1];
+			fifo->lineSpriteX[slot] = fifo->lineSpriteX[slot - 1];
+			slot--;
+		}
+		fifo->lineSprites[slot] = sprite;
+		fifo->lineSpriteX[slot] = xPos;
+		fifo->lineSpriteCount++;
+	}
+}
+
+static void stepDot(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	fifo->dots++;
+	if (fifo->stall > 0){
+		fifo->stall--;
+		return;
+	}
+
+	if (windowStartsHere(fifo)){
+		startWindow(gameboy, fifo);
+	}
+
+	//a sprite at x holds the pixels up while it's fetched
+	if (fifo->spriteFetchDots > 0){
+		fifo->spriteFetchDots--;
+		if (fifo->spriteFetchDots == 0){
+			fetchSprite(gameboy, fifo);
+		}
+		return;
+	}
+	if (spritePending(fifo)){
+		//the background fetcher gets to finish the tile it's on first
+		if (!fetcherIdle(fifo) || (fifo->backgroundCount == 0)){
+			advanceFetcher(gameboy, fifo);
+		}
+		else {
+			fifo->spriteFetchDots = SPRITE_FETCH_DOTS - 1;
+		}
+		return;
+	}
+
+	advanceFetcher(gameboy, fifo);
+	outputPixel(gameboy, fifo);
+}
+
+static bool windowStartsHere(struct pixelFifo * fifo)
+{
+	//WX is offset by 7, so WX < 7 starts the window at 0 with its first few
+	//pixels cut off
+	if (fifo->inWindow || !fifo->windowEnabled){
+		return false;
+	}
+	if (!fifo->windowYReached || (fifo->windowX >= X + 7)){
+		return false;
+	}
+	int windowStart = (fifo->windowX < 7) ? 0 : fifo->windowX - 7;
+	return fifo->x == windowStart;
+}
+
+static void startWindow(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	//whatever background was fetched is dropped and the fetcher starts over
+	//from the window's first tile
+	uint8_t windowX = fifo->windowX;
+	fifo->inWindow = true;
+	fifo->windowLine = gameboy->screen.windowLine++;
+	fifo->backgroundCount = 0;
+	fifo->step = FETCH_TILE;
+	fifo->stepDots = 0;
+	fifo->fetchX = 0;
+	fifo->discard = (windowX < 7) ? 7 - windowX : 0;
+}
+
+static bool spritePending(struct pixelFifo * fifo)
+{
+	while ((fifo->nextSprite < fifo->lineSpriteCount) && (fifo->lineSpriteX[fifo->nextSprite] <= fifo->x + 8)){
+		if (fifo->spritesEnabled){
+			return true;
+		}
+		//sprites switched off aren't fetched, and cost nothing
+		fifo->nextSprite++;
+	}
+	return false;
+}
+
+static bool fetcherIdle(struct pixelFifo * fifo)
+{
+	//between tiles - either waiting to push, or about to start the next one
+	return (fifo->step == FETCH_PUSH) || ((fifo->step == FETCH_TILE) && (fifo->stepDots == 0));
+}
+
+static void advanceFetcher(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	if (fifo->step == FETCH_PUSH){
+		//8 pixels go in once the FIFO has room for them
+		if (fifo->backgroundCount > FIFO_SIZE - TILE_SIZE){
+			return;
+		}
+		if (fifo->drawPixels){
+			uint8_t colourIds[TILE_SIZE];
+			decodeTileRow(fifo->dataLow, fifo->dataHigh, colourIds);
+			for (int pixel = 0; pixel < TILE_SIZE; pixel++){
+				fifo->background[(fifo->backgroundHead + fifo->backgroundCount + pixel) % FIFO_SIZE] = colourIds[pixel];
+			}
+		}
+		fifo->backgroundCount += TILE_SIZE;
+		fifo->fetchX++;
+		fifo->step = FETCH_TILE;
+		return;
+	}
+
+	//each read takes 2 dots, and happens on the second
+	fifo->stepDots++;
+	if (fifo->stepDots < FETCH_STEP_DOTS){
+		return;
+	}
+	fifo->stepDots = 0;
+
+	//what's read doesn't affect the timing, so skipped frames read nothing
+	if (fifo->drawPixels){
+		readFetchStep(gameboy, fifo);
+	}
+	fifo->step++;
+}
+
+static void readFetchStep(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	if (fifo->step == FETCH_TILE){
+		//the registers are read at each fetch, so a change mid-line shows from
+		//the next tile on
+		uint16_t address;
+		if (fifo->inWindow){
+			uint8_t yPos = fifo->windowLine;
+			address = fifo->windowMap + ((yPos / 8) * 32) + (fifo->fetchX % 32);
+		}
+		else {
+			uint8_t yPos = fifo->scrollY + fifo->line;
+			address = fifo->backgroundMap + ((yPos / 8) * 32) + (((fifo->scrollX / 8) + fifo->fetchX) % 32);
+		}
+		fifo->tileNum = readVideoByte(gameboy, address);
+	}
+	else if (fifo->step == FETCH_DATA_LOW){
+		fifo->dataLow = readVideoByte(gameboy, getTileRowAddress(fifo));
+	}
+	else {
+		fifo->dataHigh = readVideoByte(gameboy, getTileRowAddress(fifo) + 1);
+	}
+}
+
+static uint16_t getTileRowAddress(struct pixelFifo * fifo)
+{
+	uint8_t yPos = fifo->inWindow ? fifo->windowLine : (uint8_t)(fifo->scrollY + fifo->line);
+
+	//0x8000 addressing is unsigned, 0x8800 addressing is signed from 0x9000
+	uint16_t tileAddress;
+	if (fifo->unsignedTiles){
+		tileAddress = TILE_DATA_START + (fifo->tileNum * BYTES_PER_TILE);
+	}
+	else {
+		tileAddress = 0x9000 + ((int8_t)fifo->tileNum * BYTES_PER_TILE);
+	}
+	return tileAddress + ((yPos % 8) * 2);
+}
+
+static void fetchSprite(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	int sprite = fifo->lineSprites[fifo->nextSprite];
+	int xPos = fifo->lineSpriteX[fifo->nextSprite] - 8;
+	fifo->nextSprite++;
+	if (!fifo->drawPixels){
+		return;
+	}
+
+	const uint8_t * attributes = &gameboy->memory.spriteTable[sprite * BYTES_PER_SPRITE];
+	int height = fifo->tallSprites ? 16 : 8;
+	uint8_t tileNum = fifo->tallSprites ? (attributes[2] & 0xFE) : attributes[2];
+	uint8_t flags = attributes[3];
+
+	int row = (fifo->line - (attributes[0] - 16)) & (height - 1);
+	if (isBitSet(flags, 6)){
+		row = height - 1 - row;
+	}
+
+	//sprites always use 0x8000 tile addressing
+	uint16_t address = TILE_DATA_START + ((tileNum + (row / TILE_SIZE)) * BYTES_PER_TILE) + ((row % TILE_SIZE) * 2);
+	uint8_t colourIds[TILE_SIZE];
+	decodeTileRow(readVideoByte(gameboy, address), readVideoByte(gameboy, address + 1), colourIds);
+
+	//a pixel already in the FIFO belongs to a sprite with priority over this
+	//one, so only transparent slots are filled
+	for (int pixel = 0; pixel < TILE_SIZE; pixel++){
+		int slot = xPos + pixel - fifo->x;
+		if (slot < 0){
+			continue; //off the left edge
+		}
+		struct spritePixel * out = &fifo->sprites[(fifo->spriteHead + slot) % TILE_SIZE];
+		uint8_t colourId = isBitSet(flags, 5) ? colourIds[7 - pixel] : colourIds[pixel];
+		if ((out->colourId == 0) && (colourId != 0)){
+			out->colourId = colourId;
+			out->palette = isBitSet(flags, 4) ? OBJ_PALETTE_1 : OBJ_PALETTE_0;
+			out->behindBackground = isBitSet(flags, 7);
+		}
+	}
+}
+
+static void outputPixel(struct gameboy * gameboy, struct pixelFifo * fifo)
+{
+	if (fifo->backgroundCount == 0){
+		return;
+	}
+	uint8_t backgroundId = fifo->background[fifo->backgroundHead];
+	fifo->backgroundHead = (fifo->backgroundHead + 1) % FIFO_SIZE;
+	fifo->backgroundCount--;
+	if (fifo->discard > 0){
+		fifo->discard--;
+		return;
+	}
+	if (!fifo->drawPixels){
+		fifo->x++;
+		return;
+	}
+
+	struct spritePixel sprite = fifo->sprites[fifo->spriteHead];
+	memset(&fifo->sprites[fifo->spriteHead], 0, sizeof(struct spritePixel));
+	fifo->spriteHead = (fifo->spriteHead + 1) % TILE_SIZE;
+
+	//with the background off it's colour 0, and sprites behind it always show.
+	//The palettes are read as the pixel goes out
+	const struct palettes * palettes = &gameboy->screen.palettes;
+	if (!fifo->backgroundEnabled){
+		backgroundId = 0;
+	}
+	uint8_t pixel = palettes->pixel[BG_PALETTE][backgroundId];
+	if ((sprite.colourId != 0) && !(sprite.behindBackground && (backgroundId != 0))){
+		pixel = palettes->pixel[sprite.palette][sprite.colourId];
+	}
+	gameboy->screen.indexBuffer[(fifo->line * X) + fifo->x] = pixel;
+	fifo->x++;
+}
+
+static uint8_t readVideoByte(struct gameboy * gameboy, uint16_t address)
+{
+	uint16_t offset = address - VRAM_START;
+	return gameboy->memory.videoRam[offset >> PAGE_SHIFT]->data[offset & PAGE_MASK];
+}
@@ -0,0 +1,277 @@
+#include "../include/renderThread.h"
+#include "../include/renderer.h"
+#include "../include/gameboy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+static void * runRenderThread(void * arg);
+static void applySnapshot(struct renderThread * renderThread, const struct renderJob * job);
+static struct renderJob * waitForFreeJob(struct renderThread * renderThread);
+static void freeRenderThread(struct renderThread * renderThread);
+static void copyLinesInProgress(struct renderThread * renderThread, struct screen * screen);
+
+bool startRenderThread(struct gameboy * gameboy)
+{
+	if (gameboy->screen.renderThread != NULL){
+		return true;
+	}
+	if (gameboy->screen.renderMode == RENDER_PIXEL_FIFO){
+		//the FIFO draws in step with the CPU - there's nothing to hand over
+		return false;
+	}
+
+	//anything logged so far is drawn here, the thread takes over from now
+	renderPendingLines(gameboy);
+
+	struct renderThread * renderThread = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct renderThread));
+	if (renderThread == NULL){
+		return false;
+	}
+	memset(renderThread, 0, sizeof(struct renderThread));
+	renderThread->tileCache = createTileCache(gameboy->screen.colourFrames);
+	renderThread->spriteCache = createSpriteCache();
+	if ((renderThread->tileCache == NULL) || (renderThread->spriteCache == NULL)){
+		freeRenderThread(renderThread);
+		return false;
+	}
+
+	//the first job brings the thread's copies of VRAM and OAM up to date, and
+	//the frame in progress keeps whatever lines were already drawn
+	renderThread->videoRamDirty = ALL_VRAM_BLOCKS;
+	renderThread->spriteTableChanged = true;
+	memcpy(renderThread->frames[0], gameboy->screen.indexBuffer, X * Y);
+	memcpy(renderThread->frameHashes[0], gameboy->screen.lineHashes, sizeof(renderThread->frameHashes[0]));
+	if (gameboy->screen.lineColours != NULL){
+		memcpy(renderThread->frameColours[0], gameboy->screen.lineColours, sizeof(renderThread->frameColours[0]));
+	}
+
+	if (pthread_create(&renderThread->thread, NULL, runRenderThread, renderThread) != 0){
+		freeRenderThread(renderThread);
+		return false;
+	}
+	gameboy->screen.renderThread = renderThread;
+	return true;
+}
+
+void stopRenderThread(struct gameboy * gameboy)
+{
+	struct renderThread * renderThread = gameboy->screen.renderThread;
+	if (renderThread == NULL){
+		return;
+	}
+
+	//the thread only stops once it has drained the queue
+	atomic_store(&renderThread->stop, true);
+	pthread_join(renderThread->thread, NULL);
+
+	//leave the index buffer as drawing inline would have: the last finished
+	//frame, with the lines drawn so far of the one in progress on top
+	collectFrame(gameboy);
+	copyLinesInProgress(renderThread, &gameboy->screen);
+
+	gameboy->screen.renderThread = NULL;
+	freeRenderThread(renderThread);
+}
+
+void submitLines(struct gameboy * gameboy, bool endOfFrame)
+{
+	struct renderThread * renderThread = gameboy->screen.renderThread;
+	struct frameLog * frameLog = gameboy->screen.frameLog;
+	int first = (frameLog != NULL) ? frameLog->rendered : 0;
+	int last = (frameLog != NULL) ? frameLog->logged : 0;
+	if ((first >= last) && !endOfFrame){
+		return;
+	}
+
+	struct renderJob * job = waitForFreeJob(renderThread);
+	job->first = first;
+	job->last = last;
+	job->endOfFrame = endOfFrame;
+	job->cgb = gameboy->cartridge.cgb;
+	if (first < last){
+		memcpy(&job->lines[first], &frameLog->lines[first], (last - first) * sizeof(struct scanlineState));
+		if (gameboy->screen.loggedColours != NULL){
+			memcpy(&job->lineColours[first], &gameboy->screen.loggedColours[first], (last - first) * sizeof(job->lineColours[0]));
+		}
+		frameLog->rendered = last;
+	}
+
+	//only the blocks written since the last job. Bank 1 is only there on a CGB
+	job->videoRamBlocks = renderThread->videoRamDirty;
+	for (int block = 0; block < NO_OF_VRAM_BLOCKS; block++){
+		if (!(job->videoRamBlocks & ((uint64_t)1 << block))){
+			continue;
+		}
+		int offset = block << VRAM_BLOCK_SHIFT;
+		const struct page * page = gameboy->memory.videoRam[offset >> PAGE_SHIFT];
+		if (page != NULL){
+			memcpy(&job->videoRam[offset], &page->data[offset & PAGE_MASK], VRAM_BLOCK_SIZE);
+		}
+		else {
+			memset(&job->videoRam[offset], 0, VRAM_BLOCK_SIZE);
+		}
+	}
+	job->hasSpriteTable = renderThread->spriteTableChanged;
+	if (job->hasSpriteTable){
+		memcpy(job->spriteTable, gameboy->memory.spriteTable, SPRITE_RAM_SIZE);
+	}
+	renderThread->videoRamDirty = 0;
+	renderThread->spriteTableChanged = false;
+
+	renderThread->linesSubmitted = last;
+	if (endOfFrame){
+		renderThread->framesSubmitted++;
+		renderThread->linesSubmitted = 0;
+	}
+	//publish the job - everything written above is visible to the render thread
+	atomic_store_explicit(&renderThread->head, atomic_load_explicit(&renderThread->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+void markVideoRamDirty(struct gameboy * gameboy, uint16_t address)
+{
+	//called before the write, with the bank it's going to
+	int offset = (gameboy->memory.videoRamBank * VRAM_SIZE) + (address - VRAM_START);
+	gameboy->screen.renderThread->videoRamDirty |= (uint64_t)1 << (offset >> VRAM_BLOCK_SHIFT);
+}
+
+void copyRenderedLines(struct gameboy * gameboy, struct screen * screen)
+{
+	//for a fork, which draws inline - the frame as drawing inline would have
+	//left it, without collecting anything on the parent's behalf
+	struct renderThread * renderThread = gameboy->screen.renderThread;
+	while (atomic_load_explicit(&renderThread->tail, memory_order_acquire) != atomic_load_explicit(&renderThread->head, memory_order_relaxed)){
+		sched_yield();
+	}
+	if (renderThread->framesCollected != renderThread->framesSubmitted){
+		unsigned int frame = renderThread->framesSubmitted - 1;
+		memcpy(screen->indexBuffer, renderThread->frames[frame % 2], X * Y);
+		memcpy(screen->lineHashes, renderThread->frameHashes[frame % 2], sizeof(renderThread->frameHashes[0]));
+		if (screen->lineColours != NULL){
+			memcpy(screen->lineColours, renderThread->frameColours[frame % 2], sizeof(renderThread->frameColours[0]));
+		}
+	}
+	copyLinesInProgress(renderThread, screen);
+}
+
+bool collectFrame(struct gameboy * gameboy)
+{
+	struct renderThread * renderThread = gameboy->screen.renderThread;
+	if (renderThread->framesCollected == renderThread->framesSubmitted){
+		return false;
+	}
+
+	//called a frame after it was submitted, so this rarely has to wait
+	while (atomic_load_explicit(&renderThread->framesRendered, memory_order_acquire) < renderThread->framesSubmitted){
+		sched_yield();
+	}
+	unsigned int frame = renderThread->framesSubmitted - 1;
+	memcpy(gameboy->screen.indexBuffer, renderThread->frames[frame % 2], X * Y);
+	memcpy(gameboy->screen.lineHashes, renderThread->frameHashes[frame % 2], sizeof(renderThread->frameHashes[0]));
+	if (gameboy->screen.lineColours != NULL){
+		memcpy(gameboy->screen.lineColours, renderThread->frameColours[frame % 2], sizeof(renderThread->frameColours[0]));
+	}
+	renderThread->framesCollected = renderThread->framesSubmitted;
+	return true;
+}
+
+static void * runRenderThread(void * arg)
+{
+	struct renderThread * renderThread = arg;
+	unsigned int tail = 0;
+	unsigned int frame = 0;
+	struct renderer renderer = {
+		.spriteTable = renderThread->spriteTable,
+		.tileCache = renderThread->tileCache,
+		.spriteCache = renderThread->spriteCache,
+		.indexBuffer = renderThread->frames[0],
+		.lineColours = renderThread->frameColours[0],
+		.lineHashes = renderThread->frameHashes[0]
+	};
+	for (int i = 0; i < TOTAL_VRAM_PAGES; i++){
+		renderer.videoRam[i] = &renderThread->videoRam[i * PAGE_SIZE];
+	}
+
+	while (true){
+		if (tail == atomic_load_explicit(&renderThread->head, memory_order_acquire)){
+			if (atomic_load(&renderThread->stop)){
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		const struct renderJob * job = &renderThread->jobs[tail % RENDER_QUEUE_LENGTH];
+		applySnapshot(renderThread, job);
+		renderer.cgb = job->cgb;
+		renderer.loggedColours = job->lineColours;
+		for (int line = job->first; line < job->last; line++){
+			renderLine(&renderer, line, &job->lines[line]);
+		}
+		if (job->endOfFrame){
+			frame++;
+			renderer.indexBuffer = renderThread->frames[frame % 2];
+			renderer.lineColours = renderThread->frameColours[frame % 2];
+			renderer.lineHashes = renderThread->frameHashes[frame % 2];
+			atomic_store_explicit(&renderThread->framesRendered, frame, memory_order_release);
+		}
+
+		//hand the slot back
+		tail++;
+		atomic_store_explicit(&renderThread->tail, tail, memory_order_release);
+	}
+	return NULL;
+}
+
+static void applySnapshot(struct renderThread * renderThread, const struct renderJob * job)
+{
+	for (int block = 0; block < NO_OF_VRAM_BLOCKS; block++){
+		if (!(job->videoRamBlocks & ((uint64_t)1 << block))){
+			continue;
+		}
+		//only the tile rows that actually changed need decoding again
+		int offset = block << VRAM_BLOCK_SHIFT;
+		int bank = offset / VRAM_SIZE;
+		const uint8_t * old = &renderThread->videoRam[offset];
+		const uint8_t * new = &job->videoRam[offset];
+		for (int i = 0; i < VRAM_BLOCK_SIZE; i += 2){
+			uint16_t address = VRAM_START + ((offset + i) % VRAM_SIZE);
+			if ((address < TILE_DATA_END) && (memcmp(&old[i], &new[i], 2) != 0)){
+				markTileRowDirty(renderThread->tileCache, bank, address);
+			}
+		}
+		memcpy(&renderThread->videoRam[offset], new, VRAM_BLOCK_SIZE);
+	}
+	if (job->hasSpriteTable){
+		memcpy(renderThread->spriteTable, job->spriteTable, SPRITE_RAM_SIZE);
+		renderThread->spriteCache->dirty = true;
+	}
+}
+
+static struct renderJob * waitForFreeJob(struct renderThread * renderThread)
+{
+	unsigned int head = atomic_load_explicit(&renderThread->head, memory_order_relaxed);
+	while (head - atomic_load_explicit(&renderThread->tail, memory_order_acquire) == RENDER_QUEUE_LENGTH){
+		sched_yield();
+	}
+	return &renderThread->jobs[head % RENDER_QUEUE_LENGTH];
+}
+
+static void freeRenderThread(struct renderThread * renderThread)
+{
+	free(renderThread->tileCache);
+	free(renderThread->spriteCache);
+	free(renderThread);
+}
+
+static void copyLinesInProgress(struct renderThread * renderThread, struct screen * screen)
+{
+	//the lines drawn so far of the frame in progress, over the last finished one
+	unsigned int frame = renderThread->framesSubmitted % 2;
+	int lines = renderThread->linesSubmitted;
+	memcpy(screen->indexBuffer, renderThread->frames[frame], lines * X);
+	memcpy(screen->lineHashes, renderThread->frameHashes[frame], lines * sizeof(renderThread->frameHashes[0][0]));
+	if (screen->lineColours != NULL){
+		memcpy(screen->lineColours, renderThread->frameColours[frame], lines * sizeof(renderThread->frameColours[0][0]));
+	}
+}
@@ -0,0 +1,364 @@
+#include "../include/renderer.h"
+#include "../include/bitUtils.h"
+#include "../include/memory.h"
+#include "../include/tileDecode.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool backgroundTilesEnabled(const struct scanlineState * state);
+static bool spritesEnabled(const struct scanlineState * state);
+
+static void renderColourLine(struct renderer * renderer, int line, const struct scanlineState * state);
+static void renderTiles(struct renderer * renderer, int scanline, const struct scanlineState * state,
+	uint8_t * colourIds, uint8_t * attributes);
+static void renderTileSpan(struct renderer * renderer, uint8_t * colourIds, uint8_t * attributes, int start, int end,
+	uint16_t tileMap, uint8_t xOffset, uint8_t yPos, bool unsig);
+static void renderSprites(struct renderer * renderer, int scanline, const struct scanlineState * state,
+	const uint8_t * backgroundIds, const uint8_t * backgroundAttributes);
+static void buildSpriteCache(struct renderer * renderer, bool tallSprites);
+
+static const uint8_t * getTileRow(struct renderer * renderer, int tile, int row);
+static int getTileIndex(uint8_t tileNum, bool unsig);
+static uint8_t readVideoByte(struct renderer * renderer, int bank, uint16_t address);
+static uint64_t mixHash(uint64_t hash, const uint8_t * data, int length);
+
+void renderLine(struct renderer * renderer, int line, const struct scanlineState * state)
+{
+	if (renderer->cgb){
+		renderColourLine(renderer, line, state);
+		return;
+	}
+
+	//with the background off the line is colour 0. The IDs are kept for
+	//sprites that sit behind background colours 1-3
+	uint8_t colourIds[X] = {0};
+	if (backgroundTilesEnabled(state)){
+		renderTiles(renderer, line, state, colourIds, NULL);
+	}
+
+	const uint8_t * pixels = state->pixel[BG_PALETTE];
+	uint8_t * out = &renderer->indexBuffer[line * X];
+	for (int pixel = 0; pixel < X; pixel++){
+		out[pixel] = pixels[colourIds[pixel]];
+	}
+	
+	if (spritesEnabled(state)){
+		renderSprites(renderer, line, state, colourIds, NULL);
+	}
+	renderer->lineHashes[line] = hashLine(out, NULL);
+}
+
+static void renderColourLine(struct renderer * renderer, int line, const struct scanlineState * state)
+{
+	//the background is always drawn on a CGB - LCDC bit 0 decides whether it
+	//can ever be drawn over sprites instead
+	uint8_t colourIds[X];
+	uint8_t attributes[X];
+	renderTiles(renderer, line, state, colourIds, attributes);
+
+	uint8_t * out = &renderer->indexBuffer[line * X];
+	for (int pixel = 0; pixel < X; pixel++){
+		out[pixel] = colourIds[pixel] | ((attributes[pixel] & CGB_PALETTE_MASK) << PIXEL_PALETTE_SHIFT);
+	}
+
+	if (spritesEnabled(state)){
+		renderSprites(renderer, line, state, colourIds, attributes);
+	}
+	const uint16_t * colours = renderer->loggedColours[line];
+	memcpy(renderer->lineColours[line], colours, sizeof(renderer->lineColours[0]));
+	renderer->lineHashes[line] = hashLine(out, colours);
+}
+
+uint64_t hashLine(const uint8_t * pixels, const uint16_t * colours)
+{
+	//a line's X pixels, and on a CGB its colours, 8 bytes at a time. Only
+	//ever compared with the same line's hash from an earlier frame
+	uint64_t hash = mixHash(1, pixels, X);
+	if (colours != NULL){
+		hash = mixHash(hash, (const uint8_t *)colours, CGB_COLOURS * sizeof(colours[0]));
+	}
+	return hash;
+}
+
+static uint64_t mixHash(uint64_t hash, const uint8_t * data, int length)
+{
+	//length is a multiple of 8
+	for (int i = 0; i < length; i += sizeof(uint64_t)){
+		uint64_t word;
+		memcpy(&word, &data[i], sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+static bool backgroundTilesEnabled(const struct scanlineState * state)
+{
+	return isBitSet(state->control, bgDisplayEnable);
+}
+
+static bool spritesEnabled(const struct scanlineState * state)
+{
+	return isBitSet(state->control, spriteEnable);
+}
+
+static void renderTiles(struct renderer * renderer, int scanline, const struct scanlineState * state,
+	uint8_t * colourIds, uint8_t * attributes)
+{
+	//where to draw the visual area and the window
+	uint8_t scrollY = state->scrollY; //the Y origin of the visible 160x144 pixel area in the BG 256x256 map
+	uint8_t scrollX = state->scrollX; //the X coord of the scroll
+	uint8_t windowX = state->windowX; //offset by 7 - WX of 7 is the left edge
+
+	bool unsig = isBitSet(state->control, 4); //tileData at 0x8800 is signed
+	uint16_t backgroundMemory = isBitSet(state->control, 3) ? 0x9C00 : 0x9800;
+	uint16_t windowMemory = isBitSet(state->control, 6) ? 0x9C00 : 0x9800;
+
+	//the line is background up to WX and window from there to the end, so it
+	//switches at most once. Whether the window is on the line at all was
+	//decided when it was logged
+	int windowStart = X;
+	if (state->windowLine != WINDOW_HIDDEN){
+		windowStart = (windowX < 7) ? 0 : windowX - 7;
+	}
+
+	renderTileSpan(renderer, colourIds, attributes, 0, windowStart, backgroundMemory, scrollX, scrollY + scanline, unsig);
+	if (windowStart < X){
+		//the window's own pixel 0 lands on WX - 7
+		uint8_t windowOffset = 7 - windowX;
+		renderTileSpan(renderer, colourIds, attributes, windowStart, X, windowMemory, windowOffset, state->windowLine, unsig);
+	}
+}
+
+static void renderTileSpan(struct renderer * renderer, uint8_t * colourIds, uint8_t * attributes, int start, int end,
+	uint16_t tileMap, uint8_t xOffset, uint8_t yPos, bool unsig)
+{
+	//fill colourIds[start, end) from the 256x256 map, where screen pixel x is
+	//map column x + xOffset (wrapping) on map line yPos. In CGB mode each
+	//pixel's tile attributes go in attributes too
+	uint16_t rowAddress = tileMap + ((yPos / 8) * 32);
+
+	int pixel = start;
+	while (pixel < end){
+		//one map fetch and one cached row per tile. The first tile is cut
+		//short when the offset isn't a multiple of 8, the last one by end
+		uint8_t xPos = pixel + xOffset;
+		uint16_t mapAddress = rowAddress + (xPos / 8);
+		uint8_t tileNum = readVideoByte(renderer, 0, mapAddress);
+		uint8_t attribute = (attributes != NULL) ? readVideoByte(renderer, 1, mapAddress) : 0;
+
+		int tile = getTileIndex(tileNum, unsig) + (isBitSet(attribute, CGB_TILE_BANK_BIT) ? NO_OF_TILES : 0);
+		int tileLine = isBitSet(attribute, CGB_Y_FLIP_BIT) ? 7 - (yPos % 8) : yPos % 8;
+		const uint8_t * tileRow = getTileRow(renderer, tile, tileLine);
+
+		int first = xPos % 8;
+		int count = TILE_SIZE - first;
+		if (count > end - pixel){
+			count = end - pixel;
+		}
+		if (isBitSet(attribute, CGB_X_FLIP_BIT)){
+			for (int i = 0; i < count; i++){
+				colourIds[pixel + i] = tileRow[7 - (first + i)];
+			}
+		}
+		else {
+			memcpy(&colourIds[pixel], &tileRow[first], count);
+		}
+		if (attributes != NULL){
+			memset(&attributes[pixel], attribute, count);
+		}
+		pixel += count;
+	}
+}
+
+static void renderSprites(struct renderer * renderer, int scanline, const struct scanlineState * state,
+	const uint8_t * backgroundIds, const uint8_t * backgroundAttributes)
+{
+	//each sprite has 4 bytes of attributes in 0xFE00-0xFE9F: y pos, x pos, tile number, attributes
+	struct spriteCache * cache = renderer->spriteCache;
+	bool tallSprites = isBitSet(state->control, spriteSize); //8x16 sprites
+	if (cache->dirty || (cache->tallSprites != tallSprites)){
+		buildSpriteCache(renderer, tallSprites);
+	}
+
+	const struct spriteLine * line = &cache->lines[scanline];
+	int height = tallSprites ? 16 : 8;
+
+	//sprites are in priority order, so once a sprite has put an opaque pixel
+	//down nothing after it can draw there - even if the BG ends up on top.
+	//With LCDC bit 0 clear, CGB sprites go over the background regardless
+	bool covered[X] = {false};
+	bool backgroundPriority = !renderer->cgb || isBitSet(state->control, bgDisplayEnable);
+	uint8_t * out = &renderer->indexBuffer[scanline * X];
+	for (int i = 0; i < line->count; i++){
+		const uint8_t * sprite = &renderer->spriteTable[line->sprites[i] * BYTES_PER_SPRITE];
+		int yPos = sprite[0] - 16; //zero Y coord (offset by height)
+		int xPos = sprite[1] - 8; //zero X coord (offset by width)
+		uint8_t tileNum = sprite[2];
+		uint8_t attributes = sprite[3];
+
+		/* attributes table:
+			bit 7: sprite to background priority
+			bit 6: Y flip
+			bit 5: x flip
+			bit 4: colour palette number
+			bit 3: VRAM bank of the tile (CGB)
+			bit 2-0: colour palette number (CGB)
+		*/
+		bool behindBackground = isBitSet(attributes, 7);
+		bool yFlip = isBitSet(attributes, 6);
+		bool xFlip = isBitSet(attributes, 5);
+		enum paletteId palette = isBitSet(attributes, 4) ? OBJ_PALETTE_1 : OBJ_PALETTE_0;
+		int tileBank = 0;
+		uint8_t colourPixel = CGB_OBJ_PIXEL | ((attributes & CGB_PALETTE_MASK) << PIXEL_PALETTE_SHIFT);
+		if (renderer->cgb && isBitSet(attributes, CGB_TILE_BANK_BIT)){
+			tileBank = NO_OF_TILES;
+		}
+
+		//the vertical line on the sprite the scanline is at
+		int row = scanline - yPos;
+		if (yFlip){
+			row = height - 1 - row;
+		}
+		if (tallSprites){
+			tileNum &= 0xFE; //the top tile is always the even one
+		}
+
+		//sprites always use 0x8000 tile addressing
+		const uint8_t * colourIds = getTileRow(renderer, tileBank + tileNum + (row / TILE_SIZE), row % TILE_SIZE);
+		for (int pixel = 0; pixel < TILE_SIZE; pixel++){
+			int x = xPos + pixel;
+			int colourNum = xFlip ? colourIds[7 - pixel] : colourIds[pixel];
+
+			//colour 0 is transparent for sprites
+			if ((x < 0) || (x >= X) || (colourNum == 0) || covered[x]){
+				continue;
+			}
+			covered[x] = true;
+
+			if (backgroundPriority && (backgroundIds[x] != 0)){
+				bool backgroundOnTop = (backgroundAttributes != NULL) && isBitSet(backgroundAttributes[x], CGB_PRIORITY_BIT);
+				if (behindBackground || backgroundOnTop){
+					continue;
+				}
+			}
+			out[x] = renderer->cgb ? (colourPixel | colourNum) : state->pixel[palette][colourNum];
+		}
+	}
+}
+
+static void buildSpriteCache(struct renderer * renderer, bool tallSprites)
+{
+	struct spriteCache * cache = renderer->spriteCache;
+	cache->tallSprites = tallSprites;
+	int height = cache->tallSprites ? 16 : 8;
+
+	for (int line = 0; line < Y; line++){
+		cache->lines[line].count = 0;
+	}
+
+	//the hardware takes the first 10 sprites in OAM order that cover a line.
+	//Of those, the one with the smallest X is on top, then the lowest OAM
+	//index. A CGB goes by OAM index alone
+	for (int sprite = 0; sprite < NO_OF_SPRITES; sprite++){
+		const uint8_t * attributes = &renderer->spriteTable[sprite * BYTES_PER_SPRITE];
+		int yPos = attributes[0] - 16;
+		uint8_t xPos = attributes[1];
+
+		int first = (yPos < 0) ? 0 : yPos;
+		int last = (yPos + height > Y) ? Y : yPos + height;
+		for (int line = first; line < last; line++){
+			struct spriteLine * spriteLine = &cache->lines[line];
+			if (spriteLine->count == MAX_SPRITES_PER_LINE){
+				continue;
+			}
+
+			//insert after every sprite with an X <= this one, keeping OAM order for ties
+			int slot = spriteLine->count;
+			while (!renderer->cgb && (slot > 0) && (renderer->spriteTable[(spriteLine->sprites[slot - 1] * BYTES_PER_SPRITE) + 1] > xPos)){
+				spriteLine->sprites[slot] = spriteLine->sprites[slot - 1];
+				slot--;
+			}
+			spriteLine->sprites[slot] = sprite;
+			spriteLine->count++;
+		}
+	}
+
+	cache->dirty = false;
+}
+
+struct spriteCache * createSpriteCache()
+{
+	struct spriteCache * cache = malloc(sizeof(struct spriteCache));
+	if (cache != NULL){
+		cache->dirty = true;
+	}
+	return cache;
+}
+
+struct tileCache * createTileCache(bool colourMode)
+{
+	//starts with everything dirty, so rows are decoded as they're first drawn
+	int noOfTiles = colourMode ? NO_OF_CACHED_TILES : NO_OF_TILES;
+	struct tileCache * cache = malloc(sizeof(struct tileCache) + (noOfTiles * sizeof(cache->pixels[0])));
+	if (cache != NULL){
+		cache->noOfTiles = noOfTiles;
+		markAllTilesDirty(cache);
+	}
+	return cache;
+}
+
+void markTileRowDirty(struct tileCache * cache, int bank, uint16_t address)
+{
+	//only tile data is cached - tile map writes need nothing
+	if (address >= TILE_DATA_END){
+		return;
+	}
+
+	int offset = address - TILE_DATA_START;
+	int tile = (bank * NO_OF_TILES) + (offset / BYTES_PER_TILE);
+	if (tile >= cache->noOfTiles){
+		//bank 1, which a DMG never draws
+		return;
+	}
+	int row = (offset % BYTES_PER_TILE) / 2; //2 bytes per row
+	cache->dirtyRows[tile] |= 1 << row;
+}
+
+void markAllTilesDirty(struct tileCache * cache)
+{
+	memset(cache->dirtyRows, 0xFF, sizeof(cache->dirtyRows));
+}
+
+static int getTileIndex(uint8_t tileNum, bool unsig)
+{
+	//0x8000 addressing uses tiles 0-255. 0x8800 addressing treats the ID as
+	//signed, relative to 0x9000, which is tiles 128-383
+	if (unsig){
+		return tileNum;
+	}
+	return 256 + (int8_t)tileNum;
+}
+
+static const uint8_t * getTileRow(struct renderer * renderer, int tile, int row)
+{
+	struct tileCache * cache = renderer->tileCache;
+	uint8_t * pixels = cache->pixels[tile][row];
+	if (cache->dirtyRows[tile] & (1 << row)){
+		//pixel 0 in the tile is bit 7 of data 1 and data 2, pixel 1 is bit 6 etc...
+		int bank = tile / NO_OF_TILES;
+		uint16_t address = TILE_DATA_START + ((tile % NO_OF_TILES) * BYTES_PER_TILE) + (row * 2);
+		decodeTileRow(readVideoByte(renderer, bank, address), readVideoByte(renderer, bank, address + 1), pixels);
+		cache->dirtyRows[tile] &= ~(1 << row);
+	}
+	return pixels;
+}
+
+static uint8_t readVideoByte(struct renderer * renderer, int bank, uint16_t address)
+{
+	//the PPU has its own path to VRAM, so it doesn't go through readByte (and
+	//get locked out while a DMA transfer is running). It can read either bank
+	//whichever one VBK has mapped
+	uint16_t offset = address - VRAM_START;
+	return renderer->videoRam[(bank * NO_OF_VRAM_PAGES) + (offset >> PAGE_SHIFT)][offset & PAGE_MASK];
+}
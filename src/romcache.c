@@ -0,0 +1,97 @@
+#include "../include/romcache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+static struct romImage * images = NULL;
+static pthread_mutex_t imagesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t hashRom(const uint8_t * data, uint32_t size);
+static bool isSameImage(const struct romImage * image, uint64_t hash, const uint8_t * data, uint32_t size);
+
+const struct romImage * acquireRomImage(uint8_t * data, uint32_t size)
+{
+	uint64_t hash = hashRom(data, size);
+
+	pthread_mutex_lock(&imagesLock);
+	for (struct romImage * image = images; image != NULL; image = image->next){
+		if (isSameImage(image, hash, data, size)){
+			image->refCount++;
+			pthread_mutex_unlock(&imagesLock);
+			free(data);
+			return image;
+		}
+	}
+
+	struct romImage * image = malloc(sizeof(struct romImage));
+	if (image == NULL){
+		pthread_mutex_unlock(&imagesLock);
+		free(data);
+		return NULL;
+	}
+	image->hash = hash;
+	image->size = size;
+	image->refCount = 1;
+	image->data = data;
+	image->next = images;
+	images = image;
+	pthread_mutex_unlock(&imagesLock);
+
+	return image;
+}
+
+void retainRomImage(const struct romImage * image)
+{
+	if (image == NULL){
+		return;
+	}
+
+	pthread_mutex_lock(&imagesLock);
+	((struct romImage *)image)->refCount++;
+	pthread_mutex_unlock(&imagesLock);
+}
+
+void releaseRomImage(const struct romImage * image)
+{
+	if (image == NULL){
+		return;
+	}
+
+	pthread_mutex_lock(&imagesLock);
+	struct romImage ** link = &images;
+	while (*link != NULL){
+		struct romImage * current = *link;
+		if (current == image){
+			if (--current->refCount == 0){
+				//last instance using it has gone - unlink and free
+				*link = current->next;
+				free(current->data);
+				free(current);
+			}
+			break;
+		}
+		link = &current->next;
+	}
+	pthread_mutex_unlock(&imagesLock);
+}
+
+static uint64_t hashRom(const uint8_t * data, uint32_t size)
+{
+	//64 bit FNV-1a
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (uint32_t i = 0; i < size; i++){
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static bool isSameImage(const struct romImage * image, uint64_t hash, const uint8_t * data, uint32_t size)
+{
+	//the hash narrows it down, the compare rules out collisions
+	return (image->hash == hash) && (image->size == size) && (memcmp(image->data, data, size) == 0);
+}
@@ -0,0 +1,549 @@
+#include "../include/scaler.h"
+#include "../include/gameboy.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define SIMD_PIXELS 16
+
+static void * runScalerWorker(void * arg);
+static bool planPasses(struct scaler * scaler, enum scaleFilter filter, int factor);
+static void addPass(struct scaler * scaler, void (*scaleRow)(const uint8_t * const *, int, uint8_t * const *), int factor);
+static void runPass(struct scaler * scaler, int pass);
+static void scaleBand(struct scalerWorker * worker);
+static void prepareSource(struct scaler * scaler, const uint8_t * indexBuffer);
+static void padSource(struct scalePass * pass);
+static uint8_t xbrCornerScalar(const uint8_t * const * rows, int x, int sx, int sy);
+
+struct scaler * createScaler(enum scaleFilter filter, int factor, int workers)
+{
+	struct scaler * scaler = malloc(sizeof(struct scaler));
+	if (scaler == NULL){
+		return NULL;
+	}
+	memset(scaler, 0, sizeof(struct scaler));
+
+	if ((factor < 1) || (factor > MAX_SCALE) || !planPasses(scaler, filter, factor)
+		|| (workers < 0) || (workers > MAX_SCALER_WORKERS)){
+		free(scaler);
+		return NULL;
+	}
+	scaler->filter = filter;
+	scaler->factor = factor;
+
+	//one band per worker plus one for the calling thread
+	for (int i = 0; i <= workers; i++){
+		scaler->workers[i].scaler = scaler;
+		scaler->workers[i].band = i;
+	}
+
+	pthread_mutex_init(&scaler->lock, NULL);
+	pthread_cond_init(&scaler->start, NULL);
+	pthread_cond_init(&scaler->done, NULL);
+	for (int i = 0; i < scaler->passCount; i++){
+		struct scalePass * pass = &scaler->passes[i];
+		pass->source = malloc((pass->height + (2 * SCALE_PAD)) * (pass->width + (2 * SCALE_PAD)));
+		if (pass->source == NULL){
+			destroyScaler(scaler);
+			return NULL;
+		}
+	}
+	for (int i = 0; i < workers; i++){
+		if (pthread_create(&scaler->workers[i].thread, NULL, runScalerWorker, &scaler->workers[i]) != 0){
+			destroyScaler(scaler);
+			return NULL;
+		}
+		scaler->workerCount++;
+	}
+	return scaler;
+}
+
+void destroyScaler(struct scaler * scaler)
+{
+	pthread_mutex_lock(&scaler->lock);
+	scaler->stop = true;
+	pthread_cond_broadcast(&scaler->start);
+	pthread_mutex_unlock(&scaler->lock);
+	for (int i = 0; i < scaler->workerCount; i++){
+		pthread_join(scaler->workers[i].thread, NULL);
+	}
+
+	pthread_mutex_destroy(&scaler->lock);
+	pthread_cond_destroy(&scaler->start);
+	pthread_cond_destroy(&scaler->done);
+	for (int i = 0; i < scaler->passCount; i++){
+		free(scaler->passes[i].source);
+	}
+	free(scaler);
+}
+
+static bool planPasses(struct scaler * scaler, enum scaleFilter filter, int factor)
+{
+	//the filter's own pass, then the rest of the factor in 2x and 3x passes
+	//over its output. xBR only has a 2x
+	void (*scale2x)(const uint8_t * const *, int, uint8_t * const *) = scale2xRow;
+	scaler->multiple = 1;
+	switch (filter){
+		case SCALE_FILTER_NEAREST:
+			addPass(scaler, scaleNearestRow, 1);
+			scaler->multiple = factor;
+			return true;
+		case SCALE_FILTER_SCALE2X:
+			addPass(scaler, scale2xRow, 2);
+			break;
+		case SCALE_FILTER_SCALE3X:
+			addPass(scaler, scale3xRow, 3);
+			break;
+		case SCALE_FILTER_XBR:
+			addPass(scaler, scaleXBRRow, 2);
+			scale2x = scaleXBRRow;
+			break;
+		default:
+			return false;
+	}
+	if (factor % scaler->passes[0].factor != 0){
+		return false;
+	}
+	int remaining = factor / scaler->passes[0].factor;
+	while (remaining > 1){
+		if (remaining % 2 == 0){
+			addPass(scaler, scale2x, 2);
+			remaining /= 2;
+		} else if ((remaining % 3 == 0) && (filter != SCALE_FILTER_XBR)){
+			addPass(scaler, scale3xRow, 3);
+			remaining /= 3;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void addPass(struct scaler * scaler, void (*scaleRow)(const uint8_t * const *, int, uint8_t * const *), int factor)
+{
+	struct scalePass * pass = &scaler->passes[scaler->passCount];
+	pass->scaleRow = scaleRow;
+	pass->factor = factor;
+	if (scaler->passCount == 0){
+		pass->width = X;
+		pass->height = Y;
+	} else {
+		struct scalePass * previous = pass - 1;
+		pass->width = previous->width * previous->factor;
+		pass->height = previous->height * previous->factor;
+	}
+	scaler->passCount++;
+}
+
+void scaleFrame(struct scaler * scaler, const struct screen * screen, uint8_t * out, int pitch)
+{
+	//the output is X * factor by Y * factor pixels in the screen's pixel
+	//format, rows pitch bytes apart
+	scaler->screen = screen;
+	prepareSource(scaler, screen->indexBuffer);
+	scaler->out = out;
+	scaler->pitch = pitch;
+
+	for (int i = 0; i < scaler->passCount; i++){
+		if (i > 0){
+			padSource(&scaler->passes[i]);
+		}
+		runPass(scaler, i);
+	}
+}
+
+static void runPass(struct scaler * scaler, int pass)
+{
+	pthread_mutex_lock(&scaler->lock);
+	scaler->pass = pass;
+	scaler->pending = scaler->workerCount;
+	scaler->generation++;
+	pthread_cond_broadcast(&scaler->start);
+	pthread_mutex_unlock(&scaler->lock);
+
+	scaleBand(&scaler->workers[scaler->workerCount]);
+
+	pthread_mutex_lock(&scaler->lock);
+	while (scaler->pending > 0){
+		pthread_cond_wait(&scaler->done, &scaler->lock);
+	}
+	pthread_mutex_unlock(&scaler->lock);
+}
+
+static void * runScalerWorker(void * arg)
+{
+	struct scalerWorker * worker = arg;
+	struct scaler * scaler = worker->scaler;
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&scaler->lock);
+	while (true){
+		while ((scaler->generation == generation) && !scaler->stop){
+			pthread_cond_wait(&scaler->start, &scaler->lock);
+		}
+		if (scaler->stop){
+			break;
+		}
+		generation = scaler->generation;
+		pthread_mutex_unlock(&scaler->lock);
+
+		scaleBand(worker);
+
+		pthread_mutex_lock(&scaler->lock);
+		scaler->pending--;
+		if (scaler->pending == 0){
+			pthread_cond_signal(&scaler->done);
+		}
+	}
+	pthread_mutex_unlock(&scaler->lock);
+	return NULL;
+}
+
+static void scaleBand(struct scalerWorker * worker)
+{
+	struct scaler * scaler = worker->scaler;
+	struct scalePass * pass = &scaler->passes[scaler->pass];
+	int bands = scaler->workerCount + 1;
+	int firstLine = (pass->height * worker->band) / bands;
+	int lastLine = (pass->height * (worker->band + 1)) / bands;
+	int stride = pass->width + (2 * SCALE_PAD);
+	bool lastPass = scaler->pass == (scaler->passCount - 1);
+	int multiple = scaler->multiple;
+	int width = X * scaler->factor;
+	int rowBytes = width * getBytesPerPixel(scaler->screen->pixelFormat);
+
+	for (int line = firstLine; line < lastLine; line++){
+		const uint8_t * rows[5];
+		for (int i = 0; i < 5; i++){
+			rows[i] = &pass->source[((line + i) * stride) + SCALE_PAD];
+		}
+		if (!lastPass){
+			//straight into the next pass's source
+			struct scalePass * next = pass + 1;
+			int nextStride = next->width + (2 * SCALE_PAD);
+			uint8_t * filtered[3] = {NULL, NULL, NULL};
+			for (int row = 0; row < pass->factor; row++){
+				filtered[row] = &next->source[(((line * pass->factor) + row + SCALE_PAD) * nextStride) + SCALE_PAD];
+			}
+			pass->scaleRow(rows, pass->width, filtered);
+			continue;
+		}
+
+		uint8_t * const filtered[3] = {worker->filtered[0], worker->filtered[1], worker->filtered[2]};
+		pass->scaleRow(rows, pass->width, filtered);
+		//the frame line this came from, for the CGB colours
+		int screenLine = line / (pass->height / Y);
+		for (int row = 0; row < pass->factor; row++){
+			const uint8_t * indices = filtered[row];
+			if (multiple > 1){
+				int filteredWidth = pass->width * pass->factor;
+				for (int x = 0; x < filteredWidth; x++){
+					for (int i = 0; i < multiple; i++){
+						worker->expanded[(x * multiple) + i] = indices[x];
+					}
+				}
+				indices = worker->expanded;
+			}
+
+			//each filtered row is repeated multiple times, so it's converted once
+			//and copied
+			uint8_t * out = scaler->out + ((((line * pass->factor) + row) * multiple) * scaler->pitch);
+			convertPixels(scaler->screen, screenLine, indices, width, out);
+			for (int i = 1; i < multiple; i++){
+				memcpy(out + (i * scaler->pitch), out, rowBytes);
+			}
+		}
+	}
+}
+
+static void prepareSource(struct scaler * scaler, const uint8_t * indexBuffer)
+{
+	//the shades on their own (a sprite pixel and a background pixel of the
+	//same shade are the same colour). CGB frames keep the whole colour index
+	uint8_t mask = scaler->screen->colourFrames ? CGB_PIXEL_MASK : PIXEL_SHADE_MASK;
+	struct scalePass * pass = &scaler->passes[0];
+	for (int line = 0; line < Y; line++){
+		uint8_t * row = &pass->source[((line + SCALE_PAD) * SCALE_SOURCE_STRIDE) + SCALE_PAD];
+		const uint8_t * indices = &indexBuffer[line * X];
+		for (int x = 0; x < X; x++){
+			row[x] = indices[x] & mask;
+		}
+	}
+	padSource(pass);
+}
+
+static void padSource(struct scalePass * pass)
+{
+	//repeats the edge pixels outwards
+	int stride = pass->width + (2 * SCALE_PAD);
+	for (int line = 0; line < pass->height; line++){
+		uint8_t * row = &pass->source[((line + SCALE_PAD) * stride) + SCALE_PAD];
+		for (int i = 1; i <= SCALE_PAD; i++){
+			row[-i] = row[0];
+			row[pass->width - 1 + i] = row[pass->width - 1];
+		}
+	}
+	for (int i = 0; i < SCALE_PAD; i++){
+		memcpy(&pass->source[i * stride], &pass->source[SCALE_PAD * stride], stride);
+		memcpy(&pass->source[(pass->height + SCALE_PAD + i) * stride], &pass->source[(pass->height + SCALE_PAD - 1) * stride], stride);
+	}
+}
+
+void scaleNearestRow(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	memcpy(out[0], rows[2], count);
+}
+
+#ifdef HAVE_SSE2
+#define LOAD(row, x) _mm_loadu_si128((const __m128i *)&rows[row][x])
+
+static inline __m128i selectBytes(__m128i mask, __m128i ifSet, __m128i ifClear)
+{
+	return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+static inline __m128i absoluteDifference(__m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+static inline __m128i widen(__m128i bytes, bool high)
+{
+	//8 of the 16 bytes, zero extended to 16 bits
+	return high ? _mm_unpackhi_epi8(bytes, _mm_setzero_si128()) : _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+}
+
+static inline __m128i edgeWeight(__m128i d0, __m128i d1, __m128i d2, __m128i d3, __m128i centre, bool high)
+{
+	//d0 + d1 + d2 + d3 + 4 * centre, as 16 bit lanes
+	__m128i weight = _mm_add_epi16(_mm_add_epi16(widen(d0, high), widen(d1, high)), _mm_add_epi16(widen(d2, high), widen(d3, high)));
+	return _mm_add_epi16(weight, _mm_slli_epi16(widen(centre, high), 2));
+}
+
+static inline __m128i xbrCorner(const uint8_t * const * rows, int x, int sx, int sy)
+{
+	//the neighbourhood is mirrored so the corner being decided is always
+	//between E, F, H and I:
+	//      B
+	//   D  E  F  F4
+	//      H  I  I4
+	//         H5 I5  (C is diagonally above F, G diagonally left of H)
+	__m128i e = LOAD(2, x);
+	__m128i f = LOAD(2, x + sx);
+	__m128i h = LOAD(2 + sy, x);
+	__m128i i = LOAD(2 + sy, x + sx);
+	__m128i c = LOAD(2 - sy, x + sx);
+	__m128i g = LOAD(2 + sy, x - sx);
+	__m128i d = LOAD(2, x - sx);
+	__m128i b = LOAD(2 - sy, x);
+	__m128i f4 = LOAD(2, x + (2 * sx));
+	__m128i h5 = LOAD(2 + (2 * sy), x);
+	__m128i i4 = LOAD(2 + sy, x + (2 * sx));
+	__m128i i5 = LOAD(2 + (2 * sy), x + sx);
+
+	//the differences fit a byte (CGB colour indices are 0-63), but the
+	//weights reach 504, so they're summed and compared as 16 bit lanes
+	__m128i ec = absoluteDifference(e, c), eg = absoluteDifference(e, g);
+	__m128i if4 = absoluteDifference(i, f4), ih5 = absoluteDifference(i, h5);
+	__m128i hd = absoluteDifference(h, d), hi5 = absoluteDifference(h, i5);
+	__m128i fi4 = absoluteDifference(f, i4), fb = absoluteDifference(f, b);
+	__m128i hf = absoluteDifference(h, f), ei = absoluteDifference(e, i);
+	__m128i edge = _mm_packs_epi16(
+		_mm_cmplt_epi16(edgeWeight(ec, eg, if4, ih5, hf, false), edgeWeight(hd, hi5, fi4, fb, ei, false)),
+		_mm_cmplt_epi16(edgeWeight(ec, eg, if4, ih5, hf, true), edgeWeight(hd, hi5, fi4, fb, ei, true)));
+	edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(e, f), _mm_cmpeq_epi8(e, h)), edge);
+	//differences are under 128, so the signed compare is safe here
+	__m128i nearerF = _mm_cmpgt_epi8(absoluteDifference(e, h), absoluteDifference(e, f));
+	nearerF = _mm_or_si128(nearerF, _mm_cmpeq_epi8(absoluteDifference(e, h), absoluteDifference(e, f)));
+	return selectBytes(edge, selectBytes(nearerF, f, h), e);
+}
+#endif
+
+void scale2xRow(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	int x = 0;
+#ifdef HAVE_SSE2
+	//  B
+	//D E F
+	//  H
+	for (; x + SIMD_PIXELS <= count; x += SIMD_PIXELS){
+		__m128i b = LOAD(1, x);
+		__m128i d = LOAD(2, x - 1);
+		__m128i e = LOAD(2, x);
+		__m128i f = LOAD(2, x + 1);
+		__m128i h = LOAD(3, x);
+		__m128i corner = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(b, h), _mm_cmpeq_epi8(d, f)), _mm_set1_epi8(-1));
+		__m128i e0 = selectBytes(_mm_and_si128(corner, _mm_cmpeq_epi8(d, b)), d, e);
+		__m128i e1 = selectBytes(_mm_and_si128(corner, _mm_cmpeq_epi8(b, f)), f, e);
+		__m128i e2 = selectBytes(_mm_and_si128(corner, _mm_cmpeq_epi8(d, h)), d, e);
+		__m128i e3 = selectBytes(_mm_and_si128(corner, _mm_cmpeq_epi8(h, f)), f, e);
+		_mm_storeu_si128((__m128i *)&out[0][x * 2], _mm_unpacklo_epi8(e0, e1));
+		_mm_storeu_si128((__m128i *)&out[0][(x * 2) + SIMD_PIXELS], _mm_unpackhi_epi8(e0, e1));
+		_mm_storeu_si128((__m128i *)&out[1][x * 2], _mm_unpacklo_epi8(e2, e3));
+		_mm_storeu_si128((__m128i *)&out[1][(x * 2) + SIMD_PIXELS], _mm_unpackhi_epi8(e2, e3));
+	}
+#endif
+	if (x < count){
+		uint8_t * const rest[2] = {&out[0][x * 2], &out[1][x * 2]};
+		const uint8_t * restRows[5] = {&rows[0][x], &rows[1][x], &rows[2][x], &rows[3][x], &rows[4][x]};
+		scale2xRowScalar(restRows, count - x, rest);
+	}
+}
+
+void scale3xRow(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	int x = 0;
+#ifdef HAVE_SSE2
+	//A B C
+	//D E F
+	//G H I
+	for (; x + SIMD_PIXELS <= count; x += SIMD_PIXELS){
+		__m128i a = LOAD(1, x - 1);
+		__m128i b = LOAD(1, x);
+		__m128i c = LOAD(1, x + 1);
+		__m128i d = LOAD(2, x - 1);
+		__m128i e = LOAD(2, x);
+		__m128i f = LOAD(2, x + 1);
+		__m128i g = LOAD(3, x - 1);
+		__m128i h = LOAD(3, x);
+		__m128i i = LOAD(3, x + 1);
+		__m128i corner = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(b, h), _mm_cmpeq_epi8(d, f)), _mm_set1_epi8(-1));
+		__m128i db = _mm_and_si128(corner, _mm_cmpeq_epi8(d, b));
+		__m128i bf = _mm_and_si128(corner, _mm_cmpeq_epi8(b, f));
+		__m128i dh = _mm_and_si128(corner, _mm_cmpeq_epi8(d, h));
+		__m128i hf = _mm_and_si128(corner, _mm_cmpeq_epi8(h, f));
+		__m128i ea = _mm_cmpeq_epi8(e, a);
+		__m128i ec = _mm_cmpeq_epi8(e, c);
+		__m128i eg = _mm_cmpeq_epi8(e, g);
+		__m128i ei = _mm_cmpeq_epi8(e, i);
+
+		uint8_t block[9][SIMD_PIXELS];
+		_mm_storeu_si128((__m128i *)block[0], selectBytes(db, d, e));
+		_mm_storeu_si128((__m128i *)block[1], selectBytes(_mm_or_si128(_mm_andnot_si128(ec, db), _mm_andnot_si128(ea, bf)), b, e));
+		_mm_storeu_si128((__m128i *)block[2], selectBytes(bf, f, e));
+		_mm_storeu_si128((__m128i *)block[3], selectBytes(_mm_or_si128(_mm_andnot_si128(eg, db), _mm_andnot_si128(ea, dh)), d, e));
+		_mm_storeu_si128((__m128i *)block[4], e);
+		_mm_storeu_si128((__m128i *)block[5], selectBytes(_mm_or_si128(_mm_andnot_si128(ei, bf), _mm_andnot_si128(ec, hf)), f, e));
+		_mm_storeu_si128((__m128i *)block[6], selectBytes(dh, d, e));
+		_mm_storeu_si128((__m128i *)block[7], selectBytes(_mm_or_si128(_mm_andnot_si128(ei, dh), _mm_andnot_si128(eg, hf)), h, e));
+		_mm_storeu_si128((__m128i *)block[8], selectBytes(hf, f, e));
+
+		//the 3 way interleave has no cheap SSE2 shuffle, the lookups were the
+		//expensive part
+		for (int p = 0; p < SIMD_PIXELS; p++){
+			for (int row = 0; row < 3; row++){
+				uint8_t * pixel = &out[row][(x + p) * 3];
+				pixel[0] = block[row * 3][p];
+				pixel[1] = block[(row * 3) + 1][p];
+				pixel[2] = block[(row * 3) + 2][p];
+			}
+		}
+	}
+#endif
+	if (x < count){
+		uint8_t * const rest[3] = {&out[0][x * 3], &out[1][x * 3], &out[2][x * 3]};
+		const uint8_t * restRows[5] = {&rows[0][x], &rows[1][x], &rows[2][x], &rows[3][x], &rows[4][x]};
+		scale3xRowScalar(restRows, count - x, rest);
+	}
+}
+
+void scaleXBRRow(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	int x = 0;
+#ifdef HAVE_SSE2
+	for (; x + SIMD_PIXELS <= count; x += SIMD_PIXELS){
+		__m128i topLeft = xbrCorner(rows, x, -1, -1);
+		__m128i topRight = xbrCorner(rows, x, 1, -1);
+		__m128i bottomLeft = xbrCorner(rows, x, -1, 1);
+		__m128i bottomRight = xbrCorner(rows, x, 1, 1);
+		_mm_storeu_si128((__m128i *)&out[0][x * 2], _mm_unpacklo_epi8(topLeft, topRight));
+		_mm_storeu_si128((__m128i *)&out[0][(x * 2) + SIMD_PIXELS], _mm_unpackhi_epi8(topLeft, topRight));
+		_mm_storeu_si128((__m128i *)&out[1][x * 2], _mm_unpacklo_epi8(bottomLeft, bottomRight));
+		_mm_storeu_si128((__m128i *)&out[1][(x * 2) + SIMD_PIXELS], _mm_unpackhi_epi8(bottomLeft, bottomRight));
+	}
+#endif
+	if (x < count){
+		uint8_t * const rest[2] = {&out[0][x * 2], &out[1][x * 2]};
+		const uint8_t * restRows[5] = {&rows[0][x], &rows[1][x], &rows[2][x], &rows[3][x], &rows[4][x]};
+		scaleXBRRowScalar(restRows, count - x, rest);
+	}
+}
+
+void scale2xRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	for (int x = 0; x < count; x++){
+		uint8_t b = rows[1][x];
+		uint8_t d = rows[2][x - 1];
+		uint8_t e = rows[2][x];
+		uint8_t f = rows[2][x + 1];
+		uint8_t h = rows[3][x];
+		bool corner = (b != h) && (d != f);
+		out[0][x * 2] = (corner && (d == b)) ? d : e;
+		out[0][(x * 2) + 1] = (corner && (b == f)) ? f : e;
+		out[1][x * 2] = (corner && (d == h)) ? d : e;
+		out[1][(x * 2) + 1] = (corner && (h == f)) ? f : e;
+	}
+}
+
+void scale3xRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	for (int x = 0; x < count; x++){
+		uint8_t a = rows[1][x - 1], b = rows[1][x], c = rows[1][x + 1];
+		uint8_t d = rows[2][x - 1], e = rows[2][x], f = rows[2][x + 1];
+		uint8_t g = rows[3][x - 1], h = rows[3][x], i = rows[3][x + 1];
+		bool corner = (b != h) && (d != f);
+		bool db = corner && (d == b);
+		bool bf = corner && (b == f);
+		bool dh = corner && (d == h);
+		bool hf = corner && (h == f);
+		uint8_t * top = &out[0][x * 3];
+		uint8_t * middle = &out[1][x * 3];
+		uint8_t * bottom = &out[2][x * 3];
+		top[0] = db ? d : e;
+		top[1] = ((db && (e != c)) || (bf && (e != a))) ? b : e;
+		top[2] = bf ? f : e;
+		middle[0] = ((db && (e != g)) || (dh && (e != a))) ? d : e;
+		middle[1] = e;
+		middle[2] = ((bf && (e != i)) || (hf && (e != c))) ? f : e;
+		bottom[0] = dh ? d : e;
+		bottom[1] = ((dh && (e != i)) || (hf && (e != g))) ? h : e;
+		bottom[2] = hf ? f : e;
+	}
+}
+
+void scaleXBRRowScalar(const uint8_t * const * rows, int count, uint8_t * const * out)
+{
+	for (int x = 0; x < count; x++){
+		out[0][x * 2] = xbrCornerScalar(rows, x, -1, -1);
+		out[0][(x * 2) + 1] = xbrCornerScalar(rows, x, 1, -1);
+		out[1][x * 2] = xbrCornerScalar(rows, x, -1, 1);
+		out[1][(x * 2) + 1] = xbrCornerScalar(rows, x, 1, 1);
+	}
+}
+
+static uint8_t xbrCornerScalar(const uint8_t * const * rows, int x, int sx, int sy)
+{
+	int e = rows[2][x];
+	int f = rows[2][x + sx];
+	int h = rows[2 + sy][x];
+	int i = rows[2 + sy][x + sx];
+	int c = rows[2 - sy][x + sx];
+	int g = rows[2 + sy][x - sx];
+	int d = rows[2][x - sx];
+	int b = rows[2 - sy][x];
+	int f4 = rows[2][x + (2 * sx)];
+	int h5 = rows[2 + (2 * sy)][x];
+	int i4 = rows[2 + sy][x + (2 * sx)];
+	int i5 = rows[2 + (2 * sy)][x + sx];
+
+	int across = abs(e - c) + abs(e - g) + abs(i - f4) + abs(i - h5) + (4 * abs(h - f));
+	int along = abs(h - d) + abs(h - i5) + abs(f - i4) + abs(f - b) + (4 * abs(e - i));
+	if ((across < along) && (e != f) && (e != h)){
+		return (abs(e - f) <= abs(e - h)) ? f : h;
+	}
+	return e;
+}
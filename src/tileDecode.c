@@ -0,0 +1,233 @@
+#include "../include/tileDecode.h"
+#include "../include/lcd.h"
+#include <stdbool.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+#define SIMD_PIXELS 16 //pixels handled per pass of the shuffle loops
+
+#ifdef HAVE_X86_SIMD
+static bool haveSSSE3();
+static void buildShuffleTable(const struct colour * shades, uint8_t * table);
+static void mapScanlineRGBSSSE3(const uint8_t * indices, int count, const uint8_t * table, uint8_t * out);
+static void mapScanlineRGBASSSE3(const uint8_t * indices, int count, const uint8_t * table, uint8_t * out);
+static void mapScanline16SSSE3(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out);
+#endif
+
+void decodeTileRow(uint8_t low, uint8_t high, uint8_t * colourIds)
+{
+#if defined(HAVE_X86_SIMD) && defined(__SSE2__)
+	//broadcast both bitplanes, test pixel n's bit in lane n, and combine the
+	//two masks into colour IDs. Lane 0 tests bit 7 because pixel 0 is leftmost
+	const __m128i bits = _mm_setr_epi8(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i lowSet = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(low), bits), bits);
+	__m128i highSet = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8(high), bits), bits);
+	__m128i ids = _mm_or_si128(_mm_and_si128(lowSet, _mm_set1_epi8(1)), _mm_and_si128(highSet, _mm_set1_epi8(2)));
+	_mm_storel_epi64((__m128i *)colourIds, ids);
+#else
+	decodeTileRowScalar(low, high, colourIds);
+#endif
+}
+
+void mapScanlineRGB(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out)
+{
+#ifdef HAVE_X86_SIMD
+	if (haveSSSE3()){
+		uint8_t table[SIMD_PIXELS];
+		buildShuffleTable(shades, table);
+		mapScanlineRGBSSSE3(indices, count, table, out);
+		return;
+	}
+#endif
+	mapScanlineRGBScalar(indices, count, shades, out);
+}
+
+void mapScanlineRGBA(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out)
+{
+#ifdef HAVE_X86_SIMD
+	if (haveSSSE3()){
+		uint8_t table[SIMD_PIXELS];
+		buildShuffleTable(shades, table);
+		mapScanlineRGBASSSE3(indices, count, table, out);
+		return;
+	}
+#endif
+	mapScanlineRGBAScalar(indices, count, shades, out);
+}
+
+void mapScanline16(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out)
+{
+#ifdef HAVE_X86_SIMD
+	if (haveSSSE3()){
+		mapScanline16SSSE3(indices, count, shades, out);
+		return;
+	}
+#endif
+	mapScanline16Scalar(indices, count, shades, out);
+}
+
+void decodeTileRowScalar(uint8_t low, uint8_t high, uint8_t * colourIds)
+{
+	for (int pixel = 0; pixel < TILE_SIZE; pixel++){
+		int bit = 7 - pixel;
+		colourIds[pixel] = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+	}
+}
+
+void mapScanlineRGBScalar(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out)
+{
+	for (int i = 0; i < count; i++){
+		const struct colour * shade = &shades[indices[i] & 3];
+		*out++ = shade->red;
+		*out++ = shade->green;
+		*out++ = shade->blue;
+	}
+}
+
+void mapScanlineRGBAScalar(const uint8_t * indices, int count, const struct colour * shades, uint8_t * out)
+{
+	for (int i = 0; i < count; i++){
+		const struct colour * shade = &shades[indices[i] & 3];
+		*out++ = shade->red;
+		*out++ = shade->green;
+		*out++ = shade->blue;
+		*out++ = 0xFF;
+	}
+}
+
+void mapScanline16Scalar(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out)
+{
+	for (int i = 0; i < count; i++){
+		out[i] = shades[indices[i] & 3];
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+The shade table is laid out by channel - reds for indices 0-3, then greens,
+blues and alpha - so channel c of shade i is at byte (c * 4) + i. An output
+vector is built by spreading each pixel's index across the bytes it covers,
+adding the channel offset of each byte, and using that as a pshufb lookup.
+*/
+static const uint8_t rgbSpread[3][SIMD_PIXELS] = {
+	{0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+	{5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10},
+	{10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15}
+};
+
+static const uint8_t rgbChannel[3][SIMD_PIXELS] = {
+	{0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0},
+	{4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4},
+	{8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8, 0, 4, 8}
+};
+
+static const uint8_t rgbaSpread[4][SIMD_PIXELS] = {
+	{0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3},
+	{4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7},
+	{8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11},
+	{12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15}
+};
+
+static const uint8_t rgbaChannel[SIMD_PIXELS] = {0, 4, 8, 12, 0, 4, 8, 12, 0, 4, 8, 12, 0, 4, 8, 12};
+
+static bool haveSSSE3()
+{
+	static int supported = -1;
+	if (supported < 0){
+		supported = __builtin_cpu_supports("ssse3") ? 1 : 0;
+	}
+	return supported;
+}
+
+static void buildShuffleTable(const struct colour * shades, uint8_t * table)
+{
+	for (int i = 0; i < 4; i++){
+		table[i] = shades[i].red;
+		table[4 + i] = shades[i].green;
+		table[8 + i] = shades[i].blue;
+		table[12 + i] = 0xFF;
+	}
+}
+
+__attribute__((target("ssse3")))
+static void mapScanlineRGBSSSE3(const uint8_t * indices, int count, const uint8_t * table, uint8_t * out)
+{
+	const __m128i lookup = _mm_loadu_si128((const __m128i *)table);
+	const __m128i mask = _mm_set1_epi8(3);
+	int i = 0;
+	for (; i + SIMD_PIXELS <= count; i += SIMD_PIXELS){
+		__m128i ids = _mm_and_si128(_mm_loadu_si128((const __m128i *)&indices[i]), mask);
+		for (int part = 0; part < 3; part++){
+			__m128i spread = _mm_shuffle_epi8(ids, _mm_loadu_si128((const __m128i *)rgbSpread[part]));
+			__m128i key = _mm_add_epi8(spread, _mm_loadu_si128((const __m128i *)rgbChannel[part]));
+			_mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(lookup, key));
+			out += SIMD_PIXELS;
+		}
+	}
+
+	//tail - a full scanline is a multiple of 16 so this is normally empty
+	for (; i < count; i++){
+		int index = indices[i] & 3;
+		*out++ = table[index];
+		*out++ = table[4 + index];
+		*out++ = table[8 + index];
+	}
+}
+
+__attribute__((target("ssse3")))
+static void mapScanlineRGBASSSE3(const uint8_t * indices, int count, const uint8_t * table, uint8_t * out)
+{
+	const __m128i lookup = _mm_loadu_si128((const __m128i *)table);
+	const __m128i channel = _mm_loadu_si128((const __m128i *)rgbaChannel);
+	const __m128i mask = _mm_set1_epi8(3);
+	int i = 0;
+	for (; i + SIMD_PIXELS <= count; i += SIMD_PIXELS){
+		__m128i ids = _mm_and_si128(_mm_loadu_si128((const __m128i *)&indices[i]), mask);
+		for (int part = 0; part < 4; part++){
+			__m128i spread = _mm_shuffle_epi8(ids, _mm_loadu_si128((const __m128i *)rgbaSpread[part]));
+			_mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(lookup, _mm_add_epi8(spread, channel)));
+			out += SIMD_PIXELS;
+		}
+	}
+
+	for (; i < count; i++){
+		int index = indices[i] & 3;
+		*out++ = table[index];
+		*out++ = table[4 + index];
+		*out++ = table[8 + index];
+		*out++ = 0xFF;
+	}
+}
+
+__attribute__((target("ssse3")))
+static void mapScanline16SSSE3(const uint8_t * indices, int count, const uint16_t * shades, uint16_t * out)
+{
+	//two lookups, one for each byte of the pixel, then interleaved back into
+	//16 bit pixels (low byte first, as x86 is little-endian)
+	uint8_t lowBytes[SIMD_PIXELS] = {0};
+	uint8_t highBytes[SIMD_PIXELS] = {0};
+	for (int i = 0; i < 4; i++){
+		lowBytes[i] = shades[i] & 0xFF;
+		highBytes[i] = shades[i] >> 8;
+	}
+	const __m128i lookupLow = _mm_loadu_si128((const __m128i *)lowBytes);
+	const __m128i lookupHigh = _mm_loadu_si128((const __m128i *)highBytes);
+	const __m128i mask = _mm_set1_epi8(3);
+	int i = 0;
+	for (; i + SIMD_PIXELS <= count; i += SIMD_PIXELS){
+		__m128i ids = _mm_and_si128(_mm_loadu_si128((const __m128i *)&indices[i]), mask);
+		__m128i low = _mm_shuffle_epi8(lookupLow, ids);
+		__m128i high = _mm_shuffle_epi8(lookupHigh, ids);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_unpacklo_epi8(low, high));
+		_mm_storeu_si128((__m128i *)&out[i + 8], _mm_unpackhi_epi8(low, high));
+	}
+
+	for (; i < count; i++){
+		out[i] = shades[indices[i] & 3];
+	}
+}
+#endif
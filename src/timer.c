@@ -76,6 +76,6 @@ static void handleDividerRegister(struct gameboy * gameboy, int cycles)
 	gameboy->timers.dividerCounter += cycles;
 	if (gameboy->timers.dividerCounter >= OVERFLOW){
 		gameboy->timers.dividerCounter = 0;
-		gameboy->memory.mem[DIV_REG]++;
+		gameboy->memory.io[DIV_REG - IO_START]++;
 	}
 }
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/gameboy.h"
+
+/*
+Checks cheats apply and clear. Game Genie codes patch what the game reads
+from ROM (only where the compare value matches, when there is one) and are
+gone again after clearCheats - in a fork too, without touching the parent.
+GameShark codes write RAM each vblank, into the bank their type asks for,
+and stop once cleared. Codes for anything but RAM are refused.
+*/
+
+#define ROM_GAME "../games/tetris.gb"
+#define RAM_GAME "../games/pokered.gb" //has 4 banks of external RAM
+#define GAME_GENIE_COMPARE_XOR 0xBA
+#define CYCLES_PER_STEP 4
+
+static int failures = 0;
+
+static void check(bool passed, const char * what);
+static void encodeGameGenie(char * code, uint16_t address, uint8_t data, int compare);
+static void runLCDFrame(struct gameboy * gameboy);
+static void checkGameGenie();
+static void checkGameShark();
+static void checkGameSharkBanks();
+
+static void check(bool passed, const char * what)
+{
+	if (!passed){
+		fprintf(stderr, "FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static void encodeGameGenie(char * code, uint16_t address, uint8_t data, int compare)
+{
+	//ABC-DEF(-GHI), compare < 0 for none
+	sprintf(code, "%02X%X-%02X%X", data, (address >> 8) & 0xF, address & 0xFF, (address >> 12) ^ 0xF);
+	if (compare >= 0){
+		uint8_t value = compare ^ GAME_GENIE_COMPARE_XOR;
+		value = (value << 2) | (value >> 6); //rotate left 2
+		sprintf(code + strlen(code), "-%X0%X", value >> 4, value & 0xF);
+	}
+}
+
+static void runLCDFrame(struct gameboy * gameboy)
+{
+	//the LCD on its own, without the CPU, up to the end of the next frame
+	do {
+		gameboy->cpu.cycles += CYCLES_PER_STEP;
+		if (gameboy->cpu.cycles >= gameboy->screen.nextEventCycle){
+			updateGraphics(gameboy);
+		}
+		if (gameboy->cpu.cycles >= CYCLES_PER_FRAME){
+			gameboy->cpu.cycles -= CYCLES_PER_FRAME;
+			rebaseLCDCycles(gameboy, CYCLES_PER_FRAME);
+		}
+	} while (!takeFrame(gameboy));
+}
+
+static void checkGameGenie()
+{
+	struct gameboy * gameboy = createGameboy();
+	if (gameboy == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	loadGame(gameboy, ROM_GAME);
+
+	uint16_t fixed = 0x0150;
+	uint16_t banked = MBANK_START + 0x123;
+	uint8_t fixedByte = readByte(gameboy, fixed);
+	uint8_t bankedByte = readByte(gameboy, banked);
+	uint8_t nextByte = readByte(gameboy, fixed + 1);
+	char code[16];
+
+	encodeGameGenie(code, fixed, fixedByte ^ 0xFF, -1);
+	check(addGameGenieCode(gameboy, code), "a Game Genie code is accepted");
+	check(readByte(gameboy, fixed) == (fixedByte ^ 0xFF), "a Game Genie code patches ROM");
+	check(readByte(gameboy, fixed + 1) == nextByte, "a Game Genie code only patches its own byte");
+
+	encodeGameGenie(code, banked, 0x5A, bankedByte);
+	check(addGameGenieCode(gameboy, code), "a Game Genie code with a compare value is accepted");
+	check(readByte(gameboy, banked) == 0x5A, "a matching compare value patches a banked byte");
+
+	encodeGameGenie(code, banked + 1, 0x5A, readByte(gameboy, banked + 1) ^ 1);
+	uint8_t unmatched = readByte(gameboy, banked + 1);
+	check(addGameGenieCode(gameboy, code), "a Game Genie code that won't match is still accepted");
+	check(readByte(gameboy, banked + 1) == unmatched, "a compare value that doesn't match leaves ROM alone");
+	check(!addGameGenieCode(gameboy, "ABC-DEF-GH"), "a malformed Game Genie code is refused");
+
+	//a fork shares the patches, and clearing its cheats leaves the parent's
+	struct gameboy * child;
+	if (forkGameboy(gameboy, &child, 1) != 1){
+		fprintf(stderr, "Couldn't fork the gameboy\n");
+		exit(-1);
+	}
+	check(readByte(child, fixed) == (fixedByte ^ 0xFF), "a fork keeps its parent's Game Genie codes");
+	clearCheats(child);
+	check(readByte(child, fixed) == fixedByte, "clearing a fork's cheats restores its ROM");
+	check(readByte(gameboy, fixed) == (fixedByte ^ 0xFF), "clearing a fork's cheats leaves the parent's");
+	destroyGameboy(child);
+
+	clearCheats(gameboy);
+	check(readByte(gameboy, fixed) == fixedByte, "clearing cheats restores ROM");
+	check(readByte(gameboy, banked) == bankedByte, "clearing cheats restores banked ROM");
+	destroyGameboy(gameboy);
+}
+
+static void checkGameShark()
+{
+	//no game needed for work RAM
+	struct gameboy * gameboy = createGameboy();
+	if (gameboy == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	writeByte(gameboy, CONTROL_REG, 0x91);
+
+	check(addGameSharkCode(gameboy, "014223C1"), "a GameShark code is accepted");
+	check(addGameSharkCode(gameboy, "01990FDF"), "a GameShark code for the top of work RAM is accepted");
+	runLCDFrame(gameboy);
+	check(readByte(gameboy, 0xC123) == 0x42, "a GameShark code writes RAM in vblank");
+	check(readByte(gameboy, 0xDF0F) == 0x99, "every GameShark code is applied");
+	writeByte(gameboy, 0xC123, 0);
+	runLCDFrame(gameboy);
+	check(readByte(gameboy, 0xC123) == 0x42, "a GameShark code is applied every frame");
+
+	clearCheats(gameboy);
+	writeByte(gameboy, 0xC123, 0);
+	runLCDFrame(gameboy);
+	check(readByte(gameboy, 0xC123) == 0, "cleared GameShark codes aren't applied");
+
+	const char * refused[] = {
+		"01420080", //VRAM
+		"014200E0", //echo RAM
+		"014280FF", //high RAM
+		"01420040", //ROM
+		"824200C0", //an external RAM bank for work RAM
+		"984200D0", //work RAM bank 8
+		"914200C0", //a work RAM bank for fixed work RAM
+		"0142",
+		"01420G00"
+	};
+	for (int i = 0; i < (int)(sizeof(refused) / sizeof(refused[0])); i++){
+		if (addGameSharkCode(gameboy, refused[i])){
+			fprintf(stderr, "FAILED: GameShark code %s was accepted\n", refused[i]);
+			failures++;
+		}
+	}
+	destroyGameboy(gameboy);
+}
+
+static void checkGameSharkBanks()
+{
+	struct gameboy * gameboy = createGameboy();
+	if (gameboy == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	loadGame(gameboy, RAM_GAME);
+
+	//external RAM is disabled, and bank 0 is switched in
+	check(addGameSharkCode(gameboy, "827710A0"), "a GameShark code for an external RAM bank is accepted");
+	check(addGameSharkCode(gameboy, "016620A0"), "a GameShark code for external RAM is accepted");
+	check(addGameSharkCode(gameboy, "935500D0"), "a GameShark code for a colour work RAM bank is accepted");
+	applyGameSharkCodes(gameboy);
+
+	struct page ** ramPages = gameboy->cartridge.ramPages;
+	check(ramPages[2 * PAGES_PER_RAM_BANK]->data[0x10] == 0x77, "an 8x code writes its external RAM bank");
+	check(ramPages[0]->data[0x10] == 0, "an 8x code leaves the switched in bank alone");
+	check(ramPages[0]->data[0x20] == 0x66, "an 01 code writes the switched in bank");
+	check(readByte(gameboy, 0xD000) == 0, "a 9x code for a bank a DMG doesn't have goes nowhere");
+	destroyGameboy(gameboy);
+}
+
+int main(void)
+{
+	checkGameGenie();
+	checkGameShark();
+	checkGameSharkBanks();
+
+	printf("cheats: %d failures\n", failures);
+	return (failures == 0) ? 0 : -1;
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/gameboy.h"
+#include "../include/renderThread.h"
+
+/*
+Checks forked instances are isolated from each other. A fork shares every
+RAM page copy-on-write, so a write through any one of them - to VRAM, work
+RAM in either bank, or external RAM - must only be seen by that one, and
+a child running frames must leave the parent's memory as it was. A fork
+part way through a frame has to finish it with the same picture as the
+parent, drawing inline or on a render thread.
+*/
+
+#define RAM_GAME "../games/pokered.gb" //has external RAM
+#define GAME "../games/sml.gb" //an MBC1 game, which runs
+#define CHILDREN 2
+#define FRAMES 30
+#define FORK_LINE 70
+#define CYCLES_PER_STEP 4
+#define WRITE_CHANCE 40 //one step in this many writes something
+
+static const uint16_t addresses[] = {VRAM_START + 0x10, WORK_RAM_START + 0x20, WORK_RAM_START + PAGE_SIZE + 0x30, EX_RAM_START + 0x40};
+#define NO_OF_ADDRESSES (int)(sizeof(addresses) / sizeof(addresses[0]))
+
+static int failures = 0;
+
+static void checkWrites();
+static void checkRunningChild();
+static void check(bool passed, const char * what);
+static void checkValues(struct gameboy * gameboy, uint8_t expected, const char * what);
+static void writeValues(struct gameboy * gameboy, uint8_t data);
+static void readWorkRAM(struct gameboy * gameboy, uint8_t * ram);
+static void checkForkMidFrame(bool threaded);
+static bool step(struct gameboy * gameboy);
+static void randomWrite(struct gameboy * gameboy, struct gameboy * other);
+
+static void check(bool passed, const char * what)
+{
+	if (!passed){
+		fprintf(stderr, "FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static void checkValues(struct gameboy * gameboy, uint8_t expected, const char * what)
+{
+	for (int i = 0; i < NO_OF_ADDRESSES; i++){
+		if (readByte(gameboy, addresses[i]) != expected){
+			fprintf(stderr, "FAILED: %s - %04X is %02X, not %02X\n", what, addresses[i], readByte(gameboy, addresses[i]), expected);
+			failures++;
+		}
+	}
+}
+
+static void writeValues(struct gameboy * gameboy, uint8_t data)
+{
+	for (int i = 0; i < NO_OF_ADDRESSES; i++){
+		writeByte(gameboy, addresses[i], data);
+	}
+}
+
+static void readWorkRAM(struct gameboy * gameboy, uint8_t * ram)
+{
+	for (int i = 0; i < WORK_RAM_SIZE; i++){
+		ram[i] = readByte(gameboy, WORK_RAM_START + i);
+	}
+}
+
+static void checkWrites()
+{
+	struct gameboy * parent = createGameboy();
+	if (parent == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	loadGame(parent, RAM_GAME);
+	//MBC3 isn't emulated, so the external RAM is switched on directly
+	parent->cartridge.ramEnabled = true;
+	mapRAMBank(parent);
+	writeValues(parent, 0x11);
+
+	struct gameboy * children[CHILDREN];
+	if (forkGameboy(parent, children, CHILDREN) != CHILDREN){
+		fprintf(stderr, "Couldn't fork the gameboy\n");
+		exit(-1);
+	}
+	checkValues(children[0], 0x11, "a child starts with the parent's memory");
+
+	writeValues(children[0], 0x22);
+	checkValues(children[0], 0x22, "a child sees its own writes");
+	checkValues(parent, 0x11, "the parent doesn't see a child's writes");
+	checkValues(children[1], 0x11, "a sibling doesn't see a child's writes");
+
+	writeValues(parent, 0x33);
+	checkValues(parent, 0x33, "the parent sees its own writes");
+	checkValues(children[0], 0x22, "a child that wrote doesn't see the parent's writes");
+	checkValues(children[1], 0x11, "a child that didn't write doesn't see the parent's writes");
+
+	//children outlive each other and the parent in any order
+	destroyGameboy(children[0]);
+	checkValues(parent, 0x33, "the parent keeps its memory when a child is destroyed");
+	destroyGameboy(parent);
+	checkValues(children[1], 0x11, "a child keeps its memory when the parent is destroyed");
+	destroyGameboy(children[1]);
+}
+
+static void checkRunningChild()
+{
+	//the game itself writing all over the child, forked at power on so it's
+	//setting up its RAM
+	struct gameboy * parent = createGameboy();
+	if (parent == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	loadGame(parent, GAME);
+
+	struct gameboy * child;
+	if (forkGameboy(parent, &child, 1) != 1){
+		fprintf(stderr, "Couldn't fork the gameboy\n");
+		exit(-1);
+	}
+	static uint8_t before[WORK_RAM_SIZE];
+	static uint8_t after[WORK_RAM_SIZE];
+	static uint8_t childRAM[WORK_RAM_SIZE];
+	readWorkRAM(parent, before);
+	for (int i = 0; i < FRAMES; i++){
+		runFrame(child);
+	}
+	readWorkRAM(parent, after);
+	readWorkRAM(child, childRAM);
+	check(memcmp(before, childRAM, WORK_RAM_SIZE) != 0, "the running child changed its RAM");
+	check(memcmp(before, after, WORK_RAM_SIZE) == 0, "the parent's RAM is untouched by a running child");
+
+	destroyGameboy(child);
+	destroyGameboy(parent);
+}
+
+static void checkForkMidFrame(bool threaded)
+{
+	//the LCD on its own, with the screen changing as it's drawn
+	struct gameboy * parent = createGameboy();
+	if (parent == NULL){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		exit(-1);
+	}
+	writeByte(parent, CONTROL_REG, 0xF3);
+	writeByte(parent, BG_PALETTE_REG, 0xE4);
+	if (threaded && !startRenderThread(parent)){
+		fprintf(stderr, "Couldn't start the render thread\n");
+		exit(-1);
+	}
+	srand(7);
+	for (int i = 0; i < VRAM_SIZE; i++){
+		writeByte(parent, VRAM_START + i, rand());
+	}
+	//a whole frame, then part of the next
+	while (!step(parent)){
+		randomWrite(parent, NULL);
+	}
+	while (parent->screen.currentScanline != FORK_LINE){
+		randomWrite(parent, NULL);
+		step(parent);
+	}
+
+	struct gameboy * child;
+	if (forkGameboy(parent, &child, 1) != 1){
+		fprintf(stderr, "Couldn't fork the gameboy\n");
+		exit(-1);
+	}
+	//the threaded parent presents the frame a vblank later
+	int parentFrames = threaded ? 2 : 1;
+	bool childDone = false;
+	static uint8_t childFrame[X * Y];
+	while ((parentFrames > 0) || !childDone){
+		randomWrite(parent, child);
+		if (step(parent)){
+			parentFrames--;
+		}
+		if (step(child) && !childDone){
+			memcpy(childFrame, child->screen.indexBuffer, X * Y);
+			childDone = true;
+		}
+	}
+	int wrong = 0;
+	for (int i = 0; i < X * Y; i++){
+		wrong += childFrame[i] != parent->screen.indexBuffer[i];
+	}
+	if (wrong != 0){
+		fprintf(stderr, "FAILED: a child forked on line %d drew %d pixels differently to its %s parent\n",
+			FORK_LINE, wrong, threaded ? "threaded" : "inline");
+		failures++;
+	}
+
+	destroyGameboy(child);
+	destroyGameboy(parent);
+}
+
+static bool step(struct gameboy * gameboy)
+{
+	//true when a frame is finished
+	gameboy->cpu.cycles += CYCLES_PER_STEP;
+	if (gameboy->cpu.cycles >= gameboy->screen.nextEventCycle){
+		updateGraphics(gameboy);
+	}
+	if (gameboy->cpu.cycles >= CYCLES_PER_FRAME){
+		gameboy->cpu.cycles -= CYCLES_PER_FRAME;
+		rebaseLCDCycles(gameboy, CYCLES_PER_FRAME);
+	}
+	return takeFrame(gameboy);
+}
+
+static void randomWrite(struct gameboy * gameboy, struct gameboy * other)
+{
+	//the same write to both, when there are two
+	if (rand() % WRITE_CHANCE != 0){
+		return;
+	}
+	uint16_t address;
+	switch (rand() % 3){
+		case 0:
+			address = VRAM_START + (rand() % VRAM_SIZE);
+			break;
+		case 1:
+			address = BG_PALETTE_REG;
+			break;
+		default:
+			address = SCROLL_Y + (rand() % 2); //and SCROLL_X
+			break;
+	}
+	uint8_t data = rand();
+	writeByte(gameboy, address, data);
+	if (other != NULL){
+		writeByte(other, address, data);
+	}
+}
+
+int main(void)
+{
+	checkWrites();
+	checkRunningChild();
+	checkForkMidFrame(false);
+	checkForkMidFrame(true);
+
+	printf("fork isolation: %d failures\n", failures);
+	return (failures == 0) ? 0 : -1;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/inputScript.h"
+#include "../include/joypad.h"
+
+/*
+Checks input scripts parse and play back. Buttons are held from their line's
+frame until a later line changes them, comments and blank lines are skipped,
+and a script with an unknown button, a missing field or lines out of frame
+order is refused.
+*/
+
+#define SCRIPT_PATH "inputScriptTest.txt"
+
+static int failures = 0;
+
+static void check(bool passed, const char * what);
+static struct inputScript * loadScript(const char * text);
+static void checkPlayback();
+static void checkRefused();
+
+static void check(bool passed, const char * what)
+{
+	if (!passed){
+		fprintf(stderr, "FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static struct inputScript * loadScript(const char * text)
+{
+	FILE * file = fopen(SCRIPT_PATH, "w");
+	if (file == NULL){
+		fprintf(stderr, "Couldn't write %s\n", SCRIPT_PATH);
+		exit(-1);
+	}
+	fputs(text, file);
+	fclose(file);
+
+	struct inputScript * script = loadInputScript(SCRIPT_PATH);
+	remove(SCRIPT_PATH);
+	return script;
+}
+
+static void checkPlayback()
+{
+	struct inputScript * script = loadScript(
+		"#press start on the title screen, then walk right\n"
+		"120 START\n"
+		"\n"
+		"125 -\n"
+		"  300   RIGHT\n"
+		"400 RIGHT+A\n"
+		"400 UP+DOWN+LEFT+RIGHT+A+B+START+SELECT\n");
+	if (script == NULL){
+		fprintf(stderr, "FAILED: a valid script was refused\n");
+		failures++;
+		return;
+	}
+
+	check(script->count == 5, "comments and blank lines aren't events");
+	check(getScriptedButtons(script, 0) == 0, "nothing is held before the first line");
+	check(getScriptedButtons(script, 119) == 0, "a line doesn't apply before its frame");
+	check(getScriptedButtons(script, 120) == (1 << START), "a line applies on its frame");
+	check(getScriptedButtons(script, 124) == (1 << START), "buttons stay held until the next line");
+	check(getScriptedButtons(script, 125) == 0, "- releases everything");
+	//frames can be skipped over, as when the host drops frames
+	check(getScriptedButtons(script, 350) == (1 << RIGHT), "a skipped over line still applies");
+	check(getScriptedButtons(script, 400) == 0xFF, "the last line for a frame wins");
+	check(getScriptedButtons(script, 100000) == 0xFF, "the last line holds forever");
+	freeInputScript(script);
+
+	script = loadScript("");
+	check((script != NULL) && (getScriptedButtons(script, 0) == 0), "an empty script holds nothing");
+	freeInputScript(script);
+}
+
+static void checkRefused()
+{
+	const char * refused[] = {
+		"10 JUMP\n",
+		"10 a\n",
+		"10\n",
+		"START\n",
+		"20 A\n10 B\n"
+	};
+	for (int i = 0; i < (int)(sizeof(refused) / sizeof(refused[0])); i++){
+		struct inputScript * script = loadScript(refused[i]);
+		if (script != NULL){
+			fprintf(stderr, "FAILED: script \"%s\" was accepted\n", refused[i]);
+			failures++;
+			freeInputScript(script);
+		}
+	}
+	check(loadInputScript("no such script.txt") == NULL, "a missing script is refused");
+}
+
+int main(void)
+{
+	checkPlayback();
+	checkRefused();
+
+	printf("input scripts: %d failures\n", failures);
+	return (failures == 0) ? 0 : -1;
+}
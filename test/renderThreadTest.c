@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/gameboy.h"
+#include "../include/renderThread.h"
+
+/*
+Checks the render thread draws bit-identical frames to drawing inline. Two
+gameboys are driven through the LCD timing (no CPU) with the same random
+writes to VRAM, OAM, the palettes, scroll and window registers landing all
+through the frame, the way a game streaming tiles in hblank would. The
+threaded one presents each frame a vblank later, so its Nth frame is
+compared with the inline one's Nth.
+*/
+
+#define FRAMES 300
+#define CYCLES_PER_STEP 4
+#define WRITE_CHANCE 40 //one step in this many writes something
+
+static uint8_t inlineFrames[FRAMES][X * Y];
+static uint8_t threadedFrames[FRAMES][X * Y];
+
+static void step(struct gameboy * gameboy, uint8_t (*frames)[X * Y], int * frameCount)
+{
+	gameboy->cpu.cycles += CYCLES_PER_STEP;
+	if (gameboy->cpu.cycles >= gameboy->screen.nextEventCycle){
+		updateGraphics(gameboy);
+	}
+	if (gameboy->cpu.cycles >= CYCLES_PER_FRAME){
+		gameboy->cpu.cycles -= CYCLES_PER_FRAME;
+		rebaseLCDCycles(gameboy, CYCLES_PER_FRAME);
+	}
+	if (takeFrame(gameboy) && (*frameCount < FRAMES)){
+		memcpy(frames[(*frameCount)++], gameboy->screen.indexBuffer, X * Y);
+	}
+}
+
+static uint16_t randomAddress()
+{
+	switch (rand() % 6){
+		case 0:
+		case 1:
+			return VRAM_START + (rand() % VRAM_SIZE);
+		case 2:
+			return SPRITE_RAM_START + (rand() % SPRITE_RAM_SIZE);
+		case 3:
+			return BG_PALETTE_REG + (rand() % 3);
+		case 4:
+			return SCROLL_Y + (rand() % 2); //and SCROLL_X
+		default:
+			return WINDOW_POS_Y + (rand() % 2);
+	}
+}
+
+int main(void)
+{
+	struct gameboy * inlined = createGameboy();
+	struct gameboy * threaded = createGameboy();
+	if ((inlined == NULL) || (threaded == NULL)){
+		fprintf(stderr, "Couldn't create the gameboys\n");
+		return -1;
+	}
+	struct gameboy * gameboys[2] = {inlined, threaded};
+	for (int i = 0; i < 2; i++){
+		writeByte(gameboys[i], CONTROL_REG, 0xF3);
+		writeByte(gameboys[i], BG_PALETTE_REG, 0xE4);
+		writeByte(gameboys[i], OBJ_PALETTE_0_REG, 0xD2);
+	}
+	if (!startRenderThread(threaded)){
+		fprintf(stderr, "Couldn't start the render thread\n");
+		return -1;
+	}
+
+	srand(5);
+	int inlineCount = 0;
+	int threadedCount = 0;
+	while (inlineCount < FRAMES){
+		if (rand() % WRITE_CHANCE == 0){
+			uint16_t address = randomAddress();
+			uint8_t data = rand();
+			writeByte(inlined, address, data);
+			writeByte(threaded, address, data);
+		}
+		step(inlined, inlineFrames, &inlineCount);
+		step(threaded, threadedFrames, &threadedCount);
+	}
+	stopRenderThread(threaded);
+
+	int mismatches = 0;
+	for (int i = 0; i < threadedCount; i++){
+		if (memcmp(inlineFrames[i], threadedFrames[i], X * Y) != 0){
+			fprintf(stderr, "frame %d differs\n", i);
+			mismatches++;
+		}
+	}
+	printf("%d frames inline, %d threaded, %d differ\n", inlineCount, threadedCount, mismatches);
+
+	destroyGameboy(inlined);
+	destroyGameboy(threaded);
+	return (mismatches == 0) ? 0 : -1;
+}
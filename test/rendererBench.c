@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/gameboy.h"
+
+/*
+Compares the scanline renderer with the pixel FIFO on the same scene - random
+tile data and maps, 40 sprites, the window on and a fine scroll. Both are
+driven through the LCD timing exactly as the emulation loop would (minus the
+CPU), checked for identical output and timed per frame. The FIFO is timed
+again with every frame skipped, when it only keeps mode 3's timing.
+*/
+
+#define FRAMES 600
+#define CYCLES_PER_STEP 4 //one NOP
+
+static double now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + (time.tv_nsec / 1e9);
+}
+
+static void setUpScene(struct gameboy * gameboy)
+{
+	srand(1);
+	for (int address = VRAM_START; address < VRAM_START + VRAM_SIZE; address++){
+		writeByte(gameboy, address, rand());
+	}
+	for (int i = 0; i < SPRITE_RAM_SIZE; i++){
+		writeByte(gameboy, SPRITE_RAM_START + i, rand());
+	}
+	writeByte(gameboy, CONTROL_REG, 0xF3); //everything on, window from 0x9C00
+	writeByte(gameboy, SCROLL_Y, 13);
+	writeByte(gameboy, SCROLL_X, 5);
+	writeByte(gameboy, WINDOW_POS_Y, 60);
+	writeByte(gameboy, WINDOW_POS_X, 87);
+	writeByte(gameboy, BG_PALETTE_REG, 0xE4);
+	writeByte(gameboy, OBJ_PALETTE_0_REG, 0xD2);
+	writeByte(gameboy, OBJ_PALETTE_1_REG, 0x1B);
+}
+
+static void runLCDFrame(struct gameboy * gameboy)
+{
+	while (gameboy->cpu.cycles < CYCLES_PER_FRAME){
+		gameboy->cpu.cycles += CYCLES_PER_STEP;
+		if (gameboy->cpu.cycles >= gameboy->screen.nextEventCycle){
+			updateGraphics(gameboy);
+		}
+	}
+	gameboy->cpu.cycles -= CYCLES_PER_FRAME;
+	rebaseLCDCycles(gameboy, CYCLES_PER_FRAME);
+}
+
+static double benchRenderer(struct gameboy * gameboy, enum renderMode mode)
+{
+	if (!setRenderMode(gameboy, mode)){
+		fprintf(stderr, "Couldn't switch renderer\n");
+		exit(-1);
+	}
+	//one frame to settle, so every line is drawn by the renderer being timed
+	runLCDFrame(gameboy);
+	runLCDFrame(gameboy);
+
+	double start = now();
+	for (int i = 0; i < FRAMES; i++){
+		runLCDFrame(gameboy);
+	}
+	return (now() - start) / FRAMES;
+}
+
+int main(void)
+{
+	struct gameboy * scanline = createGameboy();
+	struct gameboy * fifo = createGameboy();
+	if ((scanline == NULL) || (fifo == NULL)){
+		fprintf(stderr, "Couldn't create the gameboys\n");
+		return -1;
+	}
+	setUpScene(scanline);
+	setUpScene(fifo);
+
+	double scanlineTime = benchRenderer(scanline, RENDER_SCANLINE);
+	double fifoTime = benchRenderer(fifo, RENDER_PIXEL_FIFO);
+
+	if (memcmp(scanline->screen.indexBuffer, fifo->screen.indexBuffer, X * Y) != 0){
+		fprintf(stderr, "renderers disagree\n");
+		return -1;
+	}
+	printf("scanline:   %.1f us/frame\n", scanlineTime * 1e6);
+	printf("pixel FIFO: %.1f us/frame (%.2fx the cost)\n", fifoTime * 1e6, fifoTime / scanlineTime);
+
+	setFrameSkip(fifo, FRAME_SKIP_ALL, 0);
+	double skippedTime = benchRenderer(fifo, RENDER_PIXEL_FIFO);
+	printf("pixel FIFO, frames skipped: %.1f us/frame\n", skippedTime * 1e6);
+
+	destroyGameboy(scanline);
+	destroyGameboy(fifo);
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/gameboy.h"
+#include "../include/romcache.h"
+
+/*
+Checks instances running the same cart share one ROM image. Loading a ROM
+that's already loaded (or forking an instance running it) takes another
+reference to the cached image rather than holding a second copy, a
+different ROM gets its own image, and the image lives as long as the last
+instance using it.
+*/
+
+#define GAME "../games/tetris.gb"
+#define OTHER_GAME "../games/sml.gb"
+#define IMAGE_SIZE 0x100
+
+static int failures = 0;
+
+static void check(bool passed, const char * what);
+static void checkLoadedGames();
+static void checkImages();
+
+static void check(bool passed, const char * what)
+{
+	if (!passed){
+		fprintf(stderr, "FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static void checkLoadedGames()
+{
+	struct gameboy * first = createGameboy();
+	struct gameboy * second = createGameboy();
+	struct gameboy * other = createGameboy();
+	if ((first == NULL) || (second == NULL) || (other == NULL)){
+		fprintf(stderr, "Couldn't create the gameboys\n");
+		exit(-1);
+	}
+	loadGame(first, GAME);
+	loadGame(second, GAME);
+	loadGame(other, OTHER_GAME);
+
+	const struct romImage * image = first->cartridge.romImage;
+	check(second->cartridge.romImage == image, "two loads of a ROM share its image");
+	check(second->cartridge.memory == first->cartridge.memory, "two loads of a ROM map the same bytes");
+	check(image->refCount == 2, "each load holds a reference");
+	check(other->cartridge.romImage != image, "a different ROM gets its own image");
+
+	struct gameboy * child;
+	if (forkGameboy(first, &child, 1) != 1){
+		fprintf(stderr, "Couldn't fork the gameboy\n");
+		exit(-1);
+	}
+	check(child->cartridge.romImage == image, "a fork shares its parent's image");
+	check(image->refCount == 3, "a fork holds a reference");
+
+	uint8_t title = readByte(second, 0x0134);
+	destroyGameboy(first);
+	destroyGameboy(child);
+	check(image->refCount == 1, "destroying an instance drops its reference");
+	check(readByte(second, 0x0134) == title, "the last instance can still read the ROM");
+
+	//loading over a game releases the old one
+	loadGame(second, OTHER_GAME);
+	check(second->cartridge.romImage == other->cartridge.romImage, "loading over a game moves to the new image");
+	check(other->cartridge.romImage->refCount == 2, "the new image gains the reference");
+
+	destroyGameboy(second);
+	destroyGameboy(other);
+}
+
+static void checkImages()
+{
+	//the cache on its own - identical contents from two buffers
+	uint8_t * data = malloc(IMAGE_SIZE);
+	uint8_t * copy = malloc(IMAGE_SIZE);
+	uint8_t * different = malloc(IMAGE_SIZE);
+	if ((data == NULL) || (copy == NULL) || (different == NULL)){
+		fprintf(stderr, "Couldn't allocate the images\n");
+		exit(-1);
+	}
+	for (int i = 0; i < IMAGE_SIZE; i++){
+		data[i] = i * 3;
+	}
+	memcpy(copy, data, IMAGE_SIZE);
+	memcpy(different, data, IMAGE_SIZE);
+	different[IMAGE_SIZE - 1] ^= 1;
+
+	const struct romImage * image = acquireRomImage(data, IMAGE_SIZE);
+	const struct romImage * again = acquireRomImage(copy, IMAGE_SIZE); //frees copy
+	const struct romImage * another = acquireRomImage(different, IMAGE_SIZE);
+	check(image == again, "identical contents give one image");
+	check(image->data == data, "the first buffer is the one kept");
+	check(image->refCount == 2, "each acquire holds a reference");
+	check(another != image, "different contents give a different image");
+
+	releaseRomImage(again);
+	check(image->refCount == 1, "releasing drops a reference");
+	releaseRomImage(image);
+	releaseRomImage(another);
+}
+
+int main(void)
+{
+	checkLoadedGames();
+	checkImages();
+
+	printf("ROM cache: %d failures\n", failures);
+	return (failures == 0) ? 0 : -1;
+}
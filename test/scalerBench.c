@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/gameboy.h"
+#include "../include/scaler.h"
+
+/*
+Checks the vectorised scaler rows against the scalar versions - on DMG
+shades and on CGB colour indices, whose xBR weights don't fit a byte - and that a
+frame scaled across the worker pool matches one scaled on a single thread.
+Then times whole frames (scale and convert to RGBA) at the sizes a recording
+would use.
+*/
+
+#define FRAMES 300
+#define WORKERS 3
+
+struct scalerCase {
+	const char * name;
+	enum scaleFilter filter;
+	int factor;
+};
+
+static const struct scalerCase cases[] = {
+	{"nearest 4x", SCALE_FILTER_NEAREST, 4},
+	{"scale2x 2x", SCALE_FILTER_SCALE2X, 2},
+	{"scale2x 4x", SCALE_FILTER_SCALE2X, 4},
+	{"scale2x 6x", SCALE_FILTER_SCALE2X, 6},
+	{"scale2x 8x", SCALE_FILTER_SCALE2X, 8},
+	{"scale3x 3x", SCALE_FILTER_SCALE3X, 3},
+	{"scale3x 6x", SCALE_FILTER_SCALE3X, 6},
+	{"xbr 2x    ", SCALE_FILTER_XBR, 2},
+	{"xbr 4x    ", SCALE_FILTER_XBR, 4}
+};
+
+static uint8_t source[(Y + (2 * SCALE_PAD)) * SCALE_SOURCE_STRIDE];
+static uint8_t fast[3][X * 3];
+static uint8_t slow[3][X * 3];
+static uint8_t frame[X * MAX_SCALE * Y * MAX_SCALE * 4];
+static uint8_t expected[X * MAX_SCALE * Y * MAX_SCALE * 4];
+
+static double now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + (time.tv_nsec / 1e9);
+}
+
+static void checkRows(const char * name, int factor,
+	void (*simd)(const uint8_t * const *, int, uint8_t * const *),
+	void (*scalar)(const uint8_t * const *, int, uint8_t * const *))
+{
+	uint8_t * const fastRows[3] = {fast[0], fast[1], fast[2]};
+	uint8_t * const slowRows[3] = {slow[0], slow[1], slow[2]};
+	for (int line = 0; line < Y; line++){
+		const uint8_t * rows[5];
+		for (int i = 0; i < 5; i++){
+			rows[i] = &source[((line + i) * SCALE_SOURCE_STRIDE) + SCALE_PAD];
+		}
+		simd(rows, X, fastRows);
+		scalar(rows, X, slowRows);
+		for (int i = 0; i < factor; i++){
+			if (memcmp(fast[i], slow[i], X * factor) != 0){
+				fprintf(stderr, "%s mismatch on line %d\n", name, line);
+				exit(-1);
+			}
+		}
+	}
+}
+
+static double benchFrames(struct gameboy * gameboy, const struct scalerCase * scalerCase, int workers, uint8_t * out)
+{
+	struct scaler * scaler = createScaler(scalerCase->filter, scalerCase->factor, workers);
+	if (scaler == NULL){
+		fprintf(stderr, "Couldn't create the %s scaler\n", scalerCase->name);
+		exit(-1);
+	}
+	int pitch = X * scalerCase->factor * 4;
+	scaleFrame(scaler, &gameboy->screen, out, pitch);
+
+	double start = now();
+	for (int i = 0; i < FRAMES; i++){
+		scaleFrame(scaler, &gameboy->screen, out, pitch);
+	}
+	double time = (now() - start) / FRAMES;
+	destroyScaler(scaler);
+	return time;
+}
+
+int main(void)
+{
+	struct gameboy * gameboy = createGameboy();
+	if ((gameboy == NULL) || !setPixelFormat(gameboy, PIXEL_FORMAT_RGBA8888)){
+		fprintf(stderr, "Couldn't create the gameboy\n");
+		return -1;
+	}
+
+	//blocky shapes with some noise, so the edge rules have something to find
+	srand(1);
+	for (int line = 0; line < Y; line++){
+		for (int x = 0; x < X; x++){
+			int block = ((line / 4) * 7) + ((x / 3) * 13);
+			gameboy->screen.indexBuffer[(line * X) + x] = ((rand() % 8) == 0) ? (rand() & 3) : ((block / 5) & 3);
+		}
+	}
+	for (int i = 0; i < (int)sizeof(source); i++){
+		source[i] = rand() & 3;
+	}
+
+	checkRows("scale2x", 2, scale2xRow, scale2xRowScalar);
+	checkRows("scale3x", 3, scale3xRow, scale3xRowScalar);
+	checkRows("xbr", 2, scaleXBRRow, scaleXBRRowScalar);
+	for (int i = 0; i < (int)sizeof(source); i++){
+		source[i] = rand() & CGB_PIXEL_MASK;
+	}
+	checkRows("scale2x (CGB)", 2, scale2xRow, scale2xRowScalar);
+	checkRows("scale3x (CGB)", 3, scale3xRow, scale3xRowScalar);
+	checkRows("xbr (CGB)", 2, scaleXBRRow, scaleXBRRowScalar);
+
+	for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++){
+		double single = benchFrames(gameboy, &cases[i], 0, expected);
+		double pooled = benchFrames(gameboy, &cases[i], WORKERS, frame);
+		int size = X * cases[i].factor * Y * cases[i].factor * 4;
+		if (memcmp(frame, expected, size) != 0){
+			fprintf(stderr, "%s differs across the worker pool\n", cases[i].name);
+			return -1;
+		}
+		printf("%s: 1 thread %.1f us/frame, %d threads %.1f us/frame (%.0f fps)\n",
+			cases[i].name, single * 1e6, WORKERS + 1, pooled * 1e6, 1 / pooled);
+	}
+
+	destroyGameboy(gameboy);
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/lcd.h"
+#include "../include/tileDecode.h"
+
+/*
+Compares the vectorised tile row decoder and scanline mappers against the
+scalar versions. Both are run over the same data, checked for identical
+output, and timed.
+*/
+
+#define DECODE_ROUNDS 200
+#define FRAMES 2000
+
+static double now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + (time.tv_nsec / 1e9);
+}
+
+static uint8_t tileData[NO_OF_TILES * BYTES_PER_TILE];
+static uint8_t indices[X * Y];
+static uint8_t frame[X * Y * 4];
+static uint8_t expected[X * Y * 4];
+
+static const struct colour shades[4] = {
+	{255, 255, 255},
+	{0xCC, 0xCC, 0xCC},
+	{0x77, 0x77, 0x77},
+	{0, 0, 0}
+};
+
+static const uint16_t packedShades[4] = {0xFFFF, 0xCE79, 0x73AE, 0x0000}; //the shades above in RGB565
+
+static void benchDecode()
+{
+	uint8_t fast[TILE_SIZE];
+	uint8_t slow[TILE_SIZE];
+	for (int i = 0; i < (int)sizeof(tileData); i += 2){
+		decodeTileRow(tileData[i], tileData[i + 1], fast);
+		decodeTileRowScalar(tileData[i], tileData[i + 1], slow);
+		if (memcmp(fast, slow, TILE_SIZE) != 0){
+			fprintf(stderr, "decodeTileRow mismatch at row %d\n", i / 2);
+			exit(-1);
+		}
+	}
+
+	volatile uint8_t sink = 0;
+	double start = now();
+	for (int round = 0; round < DECODE_ROUNDS; round++){
+		for (int i = 0; i < (int)sizeof(tileData); i += 2){
+			decodeTileRowScalar(tileData[i], tileData[i + 1], slow);
+			sink ^= slow[round & 7];
+		}
+	}
+	double scalar = now() - start;
+
+	start = now();
+	for (int round = 0; round < DECODE_ROUNDS; round++){
+		for (int i = 0; i < (int)sizeof(tileData); i += 2){
+			decodeTileRow(tileData[i], tileData[i + 1], fast);
+			sink ^= fast[round & 7];
+		}
+	}
+	double simd = now() - start;
+
+	int rows = DECODE_ROUNDS * (sizeof(tileData) / 2);
+	printf("decode tile rows:  scalar %.2f ns/row, simd %.2f ns/row (%.2fx)\n",
+		scalar * 1e9 / rows, simd * 1e9 / rows, scalar / simd);
+}
+
+static void benchMap(const char * name, int bytesPerPixel,
+	void (*fast)(const uint8_t *, int, const struct colour *, uint8_t *),
+	void (*slow)(const uint8_t *, int, const struct colour *, uint8_t *))
+{
+	int lineBytes = X * bytesPerPixel;
+	for (int line = 0; line < Y; line++){
+		fast(&indices[line * X], X, shades, &frame[line * lineBytes]);
+		slow(&indices[line * X], X, shades, &expected[line * lineBytes]);
+	}
+	if (memcmp(frame, expected, Y * lineBytes) != 0){
+		fprintf(stderr, "%s mismatch\n", name);
+		exit(-1);
+	}
+
+	double start = now();
+	for (int i = 0; i < FRAMES; i++){
+		for (int line = 0; line < Y; line++){
+			slow(&indices[line * X], X, shades, &frame[line * lineBytes]);
+		}
+	}
+	double scalar = now() - start;
+
+	start = now();
+	for (int i = 0; i < FRAMES; i++){
+		for (int line = 0; line < Y; line++){
+			fast(&indices[line * X], X, shades, &frame[line * lineBytes]);
+		}
+	}
+	double simd = now() - start;
+
+	printf("%s: scalar %.2f us/frame, simd %.2f us/frame (%.2fx)\n",
+		name, scalar * 1e6 / FRAMES, simd * 1e6 / FRAMES, scalar / simd);
+}
+
+static void benchMap16(const char * name)
+{
+	uint16_t * fastFrame = (uint16_t *)frame;
+	uint16_t * slowFrame = (uint16_t *)expected;
+	mapScanline16(indices, X * Y, packedShades, fastFrame);
+	mapScanline16Scalar(indices, X * Y, packedShades, slowFrame);
+	if (memcmp(fastFrame, slowFrame, X * Y * sizeof(uint16_t)) != 0){
+		fprintf(stderr, "%s mismatch\n", name);
+		exit(-1);
+	}
+
+	double start = now();
+	for (int i = 0; i < FRAMES; i++){
+		for (int line = 0; line < Y; line++){
+			mapScanline16Scalar(&indices[line * X], X, packedShades, &slowFrame[line * X]);
+		}
+	}
+	double scalar = now() - start;
+
+	start = now();
+	for (int i = 0; i < FRAMES; i++){
+		for (int line = 0; line < Y; line++){
+			mapScanline16(&indices[line * X], X, packedShades, &fastFrame[line * X]);
+		}
+	}
+	double simd = now() - start;
+
+	printf("%s: scalar %.2f us/frame, simd %.2f us/frame (%.2fx)\n",
+		name, scalar * 1e6 / FRAMES, simd * 1e6 / FRAMES, scalar / simd);
+}
+
+int main(void)
+{
+	srand(1);
+	for (int i = 0; i < (int)sizeof(tileData); i++){
+		tileData[i] = rand();
+	}
+	for (int i = 0; i < (int)sizeof(indices); i++){
+		indices[i] = rand() & 3;
+	}
+
+	benchDecode();
+	benchMap("map scanline RGB ", 3, mapScanlineRGB, mapScanlineRGBScalar);
+	benchMap("map scanline RGBA", 4, mapScanlineRGBA, mapScanlineRGBAScalar);
+	benchMap16("map scanline 565 ");
+	return 0;
+}